@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  // Heap allocations made so far by any thread, counted by shadey-bench's operator new.
+  uint64_t allocationCount();
+
+  // Handed to each benchmark. Setup goes before the loop and isn't timed:
+  //
+  //   while (state.keepRunning())
+  //     doNotOptimize(thingBeingMeasured());
+  class BenchmarkState {
+  public:
+    BenchmarkState(uint64_t iterations)
+      : m_remaining(iterations) { }
+
+    bool keepRunning() {
+      if (!m_started) {
+        m_started = true;
+        m_allocations = allocationCount();
+        m_start       = std::chrono::steady_clock::now();
+      }
+
+      if (m_remaining == 0) {
+        m_elapsed     = std::chrono::steady_clock::now() - m_start;
+        m_allocations = allocationCount() - m_allocations;
+        return false;
+      }
+
+      m_remaining--;
+      return true;
+    }
+
+    // Per iteration, reported as throughput alongside the timings.
+    void setBytesProcessed(uint64_t bytes) { m_bytes = bytes; }
+
+    void setItemsProcessed(uint64_t items) { m_items = items; }
+
+    // Reports the benchmark as skipped, e.g. when vk.xml isn't around.
+    void skip(std::string reason) { m_skipReason = std::move(reason); }
+
+    uint64_t bytesProcessed() const { return m_bytes; }
+
+    uint64_t itemsProcessed() const { return m_items; }
+
+    const std::string& skipReason() const { return m_skipReason; }
+
+    std::chrono::duration<double, std::nano> elapsed() const { return m_elapsed; }
+
+    // Allocations made inside the timed loop.
+    uint64_t allocations() const { return m_allocations; }
+
+  private:
+    uint64_t                                 m_remaining;
+    bool                                     m_started     = false;
+    std::chrono::steady_clock::time_point    m_start;
+    std::chrono::duration<double, std::nano> m_elapsed     = { };
+    uint64_t                                 m_bytes       = 0;
+    uint64_t                                 m_items       = 0;
+    uint64_t                                 m_allocations = 0;
+    std::string                              m_skipReason;
+  };
+
+  using BenchmarkFunc = std::function<void(BenchmarkState&)>;
+
+  struct Benchmark {
+    std::string   name;
+    BenchmarkFunc func;
+  };
+
+  class BenchmarkRegistry : public NonCopyable {
+  public:
+    static BenchmarkRegistry* instance();
+
+    bool add(std::string name, BenchmarkFunc func);
+
+    const std::vector<Benchmark>& benchmarks() const { return m_benchmarks; }
+
+  private:
+    std::vector<Benchmark> m_benchmarks;
+  };
+
+  // Keeps the compiler from throwing away a result nobody reads.
+  template <typename T>
+  inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+#define SHADEY_BENCHMARK_CONCAT_INNER(a, b) a##b
+#define SHADEY_BENCHMARK_CONCAT(a, b) SHADEY_BENCHMARK_CONCAT_INNER(a, b)
+
+#define SHADEY_REGISTER_BENCHMARK(name, ...) \
+  static const bool SHADEY_BENCHMARK_CONCAT(g_benchmark_, __LINE__) = ::shadey::BenchmarkRegistry::instance()->add(name, __VA_ARGS__);
+
+}
\ No newline at end of file
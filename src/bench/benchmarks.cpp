@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "command_parser.h"
+#include "png_encoder.h"
+#include "renderer.h"
+#include "shader_helpers.h"
+#include "vulkan_registry.h"
+
+namespace shadey {
+
+  namespace {
+    static const std::string g_trivialGlsl =
+R"(#version 450
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+  outColor = vec4(gl_FragCoord.xy / 512.0, 0.5, 1.0);
+}
+)";
+
+    static const std::string g_heavyGlsl =
+R"(#version 450
+// SHADEY: resolution = 1024x1024
+
+layout(location = 0) out vec4 outColor;
+
+float hash(vec3 p) {
+  p = fract(p * 0.3183099 + 0.1);
+  p *= 17.0;
+  return fract(p.x * p.y * p.z * (p.x + p.y + p.z));
+}
+
+float noise(vec3 x) {
+  vec3 i = floor(x);
+  vec3 f = fract(x);
+  f = f * f * (3.0 - 2.0 * f);
+
+  return mix(mix(mix(hash(i + vec3(0, 0, 0)), hash(i + vec3(1, 0, 0)), f.x),
+                 mix(hash(i + vec3(0, 1, 0)), hash(i + vec3(1, 1, 0)), f.x), f.y),
+             mix(mix(hash(i + vec3(0, 0, 1)), hash(i + vec3(1, 0, 1)), f.x),
+                 mix(hash(i + vec3(0, 1, 1)), hash(i + vec3(1, 1, 1)), f.x), f.y), f.z);
+}
+
+float fbm(vec3 p) {
+  float value = 0.0;
+  float scale = 0.5;
+  for (int i = 0; i < 6; i++) {
+    value += scale * noise(p);
+    p *= 2.03;
+    scale *= 0.5;
+  }
+  return value;
+}
+
+float sdScene(vec3 p) {
+  float sphere = length(p - vec3(0.0, 0.0, 4.0)) - 1.0;
+  float ground = p.y + 1.0 + 0.2 * fbm(p * 2.0);
+  vec3  q      = mod(p, 2.0) - 1.0;
+  float boxes  = length(max(abs(q) - vec3(0.2), 0.0)) - 0.05;
+  return min(min(sphere, ground), max(boxes, p.y - 2.0));
+}
+
+vec3 normal(vec3 p) {
+  const vec2 e = vec2(0.001, 0.0);
+  return normalize(vec3(sdScene(p + e.xyy) - sdScene(p - e.xyy),
+                        sdScene(p + e.yxy) - sdScene(p - e.yxy),
+                        sdScene(p + e.yyx) - sdScene(p - e.yyx)));
+}
+
+void main() {
+  vec2 uv  = (gl_FragCoord.xy - 512.0) / 512.0;
+  vec3 ro  = vec3(0.0, 0.5, 0.0);
+  vec3 rd  = normalize(vec3(uv, 1.5));
+  float t  = 0.0;
+
+  for (int i = 0; i < 128; i++) {
+    float d = sdScene(ro + rd * t);
+    if (d < 0.001 || t > 50.0)
+      break;
+    t += d;
+  }
+
+  vec3 color = vec3(0.6, 0.7, 0.9);
+  if (t < 50.0) {
+    vec3 p = ro + rd * t;
+    vec3 n = normal(p);
+    float diffuse = max(dot(n, normalize(vec3(0.5, 1.0, -0.3))), 0.0);
+    color = mix(vec3(0.8, 0.6, 0.4), vec3(0.2, 0.3, 0.5), fbm(p)) * (0.2 + diffuse);
+  }
+
+  outColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}
+)";
+
+    static const std::string g_vertexGlsl =
+R"(#version 450
+
+void main() {
+  vec2 coord = vec2(float(gl_VertexIndex & 2), float(gl_VertexIndex & 1) * 2.0);
+  gl_Position = vec4(-1.0 + 2.0 * coord, 0.0, 1.0);
+}
+)";
+
+    static const std::string g_trivialHlsl =
+R"(float4 main(float4 position : SV_Position) : SV_Target {
+  return float4(position.xy / 512.0, 0.5, 1.0);
+}
+)";
+
+    static const std::string g_heavyHlsl =
+R"(// SHADEY: resolution = 1024x1024
+
+float hash(float3 p) {
+  p = frac(p * 0.3183099 + 0.1);
+  p *= 17.0;
+  return frac(p.x * p.y * p.z * (p.x + p.y + p.z));
+}
+
+float noise(float3 x) {
+  float3 i = floor(x);
+  float3 f = frac(x);
+  f = f * f * (3.0 - 2.0 * f);
+
+  return lerp(lerp(lerp(hash(i + float3(0, 0, 0)), hash(i + float3(1, 0, 0)), f.x),
+                   lerp(hash(i + float3(0, 1, 0)), hash(i + float3(1, 1, 0)), f.x), f.y),
+              lerp(lerp(hash(i + float3(0, 0, 1)), hash(i + float3(1, 0, 1)), f.x),
+                   lerp(hash(i + float3(0, 1, 1)), hash(i + float3(1, 1, 1)), f.x), f.y), f.z);
+}
+
+float fbm(float3 p) {
+  float value = 0.0;
+  float scale = 0.5;
+  [unroll] for (int i = 0; i < 6; i++) {
+    value += scale * noise(p);
+    p *= 2.03;
+    scale *= 0.5;
+  }
+  return value;
+}
+
+float sdScene(float3 p) {
+  float sphere = length(p - float3(0.0, 0.0, 4.0)) - 1.0;
+  float ground = p.y + 1.0 + 0.2 * fbm(p * 2.0);
+  float3 q     = fmod(p, 2.0) - 1.0;
+  float boxes  = length(max(abs(q) - 0.2, 0.0)) - 0.05;
+  return min(min(sphere, ground), max(boxes, p.y - 2.0));
+}
+
+float3 calcNormal(float3 p) {
+  const float2 e = float2(0.001, 0.0);
+  return normalize(float3(sdScene(p + e.xyy) - sdScene(p - e.xyy),
+                          sdScene(p + e.yxy) - sdScene(p - e.yxy),
+                          sdScene(p + e.yyx) - sdScene(p - e.yyx)));
+}
+
+float4 main(float4 position : SV_Position) : SV_Target {
+  float2 uv = (position.xy - 512.0) / 512.0;
+  float3 ro = float3(0.0, 0.5, 0.0);
+  float3 rd = normalize(float3(uv, 1.5));
+  float t   = 0.0;
+
+  for (int i = 0; i < 128; i++) {
+    float d = sdScene(ro + rd * t);
+    if (d < 0.001 || t > 50.0)
+      break;
+    t += d;
+  }
+
+  float3 color = float3(0.6, 0.7, 0.9);
+  if (t < 50.0) {
+    float3 p = ro + rd * t;
+    float3 n = calcNormal(p);
+    float diffuse = max(dot(n, normalize(float3(0.5, 1.0, -0.3))), 0.0);
+    color = lerp(float3(0.8, 0.6, 0.4), float3(0.2, 0.3, 0.5), fbm(p)) * (0.2 + diffuse);
+  }
+
+  return float4(pow(color, 1.0 / 2.2), 1.0);
+}
+)";
+
+    // Discord's message limit for Nitro users.
+    static constexpr size_t g_maxMessageLength = 4000;
+
+    static void benchCompile(BenchmarkState& state, bool hlsl, const std::string& source) {
+      std::string code = source;
+      Renderer::fixCode(hlsl, code);
+
+      state.setBytesProcessed(code.size());
+      while (state.keepRunning())
+        doNotOptimize(compileShaderUncached(hlsl, ShaderStage_Fragment, code));
+    }
+
+    static void benchCompileCached(BenchmarkState& state, bool hlsl, const std::string& source) {
+      std::string code = source;
+      Renderer::fixCode(hlsl, code);
+
+      compileShader(hlsl, ShaderStage_Fragment, code);
+
+      while (state.keepRunning())
+        doNotOptimize(compileShader(hlsl, ShaderStage_Fragment, code));
+    }
+
+    // A big shader with directives at both ends, so the parser walks all of it.
+    static std::string makeLargeSource(size_t targetSize) {
+      std::string code = "// SHADEY: clear_color = 0.1, 0.2, 0.3, 1.0\n";
+      while (code.size() < targetSize)
+        code += g_heavyGlsl;
+      code += "// SHADEY: resolution = 1024x768\n";
+      return code;
+    }
+
+    static void benchRendererOptions(BenchmarkState& state, size_t size) {
+      const std::string code = makeLargeSource(size);
+
+      state.setBytesProcessed(code.size());
+      while (state.keepRunning())
+        doNotOptimize(Renderer::getRendererOptions(code));
+    }
+
+    // Smooth gradients with a little noise, closer to real renders than random bytes.
+    static std::vector<uint8_t> makeImage(uint32_t width, uint32_t height) {
+      std::vector<uint8_t> pixels(size_t(width) * height * 4);
+
+      uint32_t seed = 0x9e3779b9;
+      for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+          seed ^= seed << 13;
+          seed ^= seed >> 17;
+          seed ^= seed << 5;
+
+          uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+          pixel[0] = uint8_t(x * 255 / width);
+          pixel[1] = uint8_t(y * 255 / height);
+          pixel[2] = uint8_t(128 + (seed & 7));
+          pixel[3] = 255;
+        }
+      }
+
+      return pixels;
+    }
+
+    static void benchEncodePng(BenchmarkState& state, uint32_t width, uint32_t height, PngCompression compression) {
+      const std::vector<uint8_t> pixels = makeImage(width, height);
+
+      state.setBytesProcessed(pixels.size());
+      while (state.keepRunning())
+        doNotOptimize(encodePng(pixels.data(), width, height, width * 4, compression));
+    }
+
+    // Same image as benchEncodePng but handed over a band of rows at a time, like tiled renders do.
+    static void benchEncodePngBands(BenchmarkState& state, uint32_t width, uint32_t height, uint32_t bandRows) {
+      const std::vector<uint8_t> pixels = makeImage(width, height);
+
+      state.setBytesProcessed(pixels.size());
+      while (state.keepRunning()) {
+        PngStreamEncoder encoder(width, height);
+        for (uint32_t row = 0; row < height; row += bandRows)
+          encoder.addRows(&pixels[size_t(row) * width * 4], std::min(bandRows, height - row), width * 4);
+        doNotOptimize(encoder.finish());
+      }
+    }
+
+    static void benchEncodeApng(BenchmarkState& state, uint32_t width, uint32_t height, uint32_t frames) {
+      const std::vector<uint8_t> pixels = makeImage(width, height);
+
+      state.setBytesProcessed(pixels.size() * frames);
+      state.setItemsProcessed(frames);
+      while (state.keepRunning()) {
+        ApngEncoder encoder(width, height, frames, 30);
+        for (uint32_t i = 0; i < frames; i++)
+          encoder.addFrame(pixels.data(), width * 4);
+        doNotOptimize(encoder.finish());
+      }
+    }
+
+    static void benchLookupVulkanType(BenchmarkState& state, const std::string& name, bool exists) {
+      VulkanRegistry* registry = VulkanRegistry::instance();
+      if (registry->size() == 0) {
+        state.skip("vk.xml not found in the working directory");
+        return;
+      }
+
+      while (state.keepRunning()) {
+        const std::string* definition = registry->find(name);
+        if ((definition != nullptr) != exists)
+          throw std::runtime_error("Unexpected lookup result for " + name);
+        doNotOptimize(definition);
+      }
+    }
+
+    static void benchLoadVulkanRegistry(BenchmarkState& state) {
+      if (VulkanRegistry::instance()->size() == 0) {
+        state.skip("vk.xml not found in the working directory");
+        return;
+      }
+
+      while (state.keepRunning())
+        doNotOptimize(VulkanRegistry("vk.xml").size());
+    }
+
+    static void benchSuggestVulkanType(BenchmarkState& state, const std::string& name) {
+      const VulkanRegistry* registry = VulkanRegistry::instance();
+      if (registry->size() == 0) {
+        state.skip("vk.xml not found in the working directory");
+        return;
+      }
+
+      while (state.keepRunning())
+        doNotOptimize(registry->suggest(name, 5));
+    }
+
+    static void benchSearchVulkanType(BenchmarkState& state, const std::string& pattern) {
+      const VulkanRegistry* registry = VulkanRegistry::instance();
+      if (registry->size() == 0) {
+        state.skip("vk.xml not found in the working directory");
+        return;
+      }
+
+      while (state.keepRunning())
+        doNotOptimize(registry->search(pattern));
+    }
+
+    static std::string makeMessage(const std::string& prefix, const std::string& language, const std::string& code, size_t length) {
+      std::string message = prefix + "```" + language + "\n" + code.substr(0, length) + "```";
+      return message;
+    }
+
+    static void benchExtractShaderProgram(BenchmarkState& state, const std::string& message) {
+      state.setBytesProcessed(message.size());
+      while (state.keepRunning()) {
+        ShaderProgram program;
+        doNotOptimize(extractShaderProgram(message, program));
+        doNotOptimize(program);
+      }
+    }
+
+    static void benchCommandArgs(BenchmarkState& state, const std::string& message) {
+      state.setBytesProcessed(message.size());
+      while (state.keepRunning())
+        doNotOptimize(splitCommandArgs(message));
+    }
+
+    static void benchCommandName(BenchmarkState& state, const std::string& message) {
+      while (state.keepRunning())
+        doNotOptimize(parseCommandName(message));
+    }
+
+    static const std::string g_shortMessage = makeMessage("", "glsl", g_trivialGlsl, g_trivialGlsl.size());
+    static const std::string g_longMessage  = makeMessage("Why is this one black?\n", "glsl", g_heavyGlsl, g_maxMessageLength - 32);
+    static const std::string g_hlslMessage  = makeMessage("", "hlsl", g_heavyHlsl, g_maxMessageLength - 32);
+    static const std::string g_stageMessage = makeMessage("", "glsl common", "float brightness() { return 0.5; }\n", 64) +
+                                              makeMessage("\n", "glsl vert", g_vertexGlsl, g_vertexGlsl.size()) +
+                                              makeMessage("\n", "glsl", g_trivialGlsl, g_trivialGlsl.size());
+    static const std::string g_chatMessage  = "has anyone tried the new driver? my shaders compile way faster now";
+    static const std::string g_benchMessage = makeMessage(">bench 64 1024x768\n", "glsl", g_heavyGlsl, g_maxMessageLength - 32);
+  }
+
+  SHADEY_REGISTER_BENCHMARK("compile/glsl/trivial",        [](BenchmarkState& state) { benchCompile(state, false, g_trivialGlsl); });
+  SHADEY_REGISTER_BENCHMARK("compile/glsl/heavy",          [](BenchmarkState& state) { benchCompile(state, false, g_heavyGlsl); });
+  SHADEY_REGISTER_BENCHMARK("compile/hlsl/trivial",        [](BenchmarkState& state) { benchCompile(state, true,  g_trivialHlsl); });
+  SHADEY_REGISTER_BENCHMARK("compile/hlsl/heavy",          [](BenchmarkState& state) { benchCompile(state, true,  g_heavyHlsl); });
+  SHADEY_REGISTER_BENCHMARK("compile/glsl/heavy/cached",   [](BenchmarkState& state) { benchCompileCached(state, false, g_heavyGlsl); });
+
+  SHADEY_REGISTER_BENCHMARK("options/4KiB",                [](BenchmarkState& state) { benchRendererOptions(state, 4 * 1024); });
+  SHADEY_REGISTER_BENCHMARK("options/256KiB",              [](BenchmarkState& state) { benchRendererOptions(state, 256 * 1024); });
+
+  SHADEY_REGISTER_BENCHMARK("png/512x512/fast",            [](BenchmarkState& state) { benchEncodePng(state, 512,  512,  PngCompression::Fast); });
+  SHADEY_REGISTER_BENCHMARK("png/512x512/default",         [](BenchmarkState& state) { benchEncodePng(state, 512,  512,  PngCompression::Default); });
+  SHADEY_REGISTER_BENCHMARK("png/1024x1024/fast",          [](BenchmarkState& state) { benchEncodePng(state, 1024, 1024, PngCompression::Fast); });
+  SHADEY_REGISTER_BENCHMARK("png/1024x1024/default",       [](BenchmarkState& state) { benchEncodePng(state, 1024, 1024, PngCompression::Default); });
+  SHADEY_REGISTER_BENCHMARK("png/1024x1024/max",           [](BenchmarkState& state) { benchEncodePng(state, 1024, 1024, PngCompression::Max); });
+  SHADEY_REGISTER_BENCHMARK("png/4096x2048/fast",          [](BenchmarkState& state) { benchEncodePng(state, 4096, 2048, PngCompression::Fast); });
+  SHADEY_REGISTER_BENCHMARK("png/4096x2048/default",       [](BenchmarkState& state) { benchEncodePng(state, 4096, 2048, PngCompression::Default); });
+  SHADEY_REGISTER_BENCHMARK("png/4096x2048/bands",         [](BenchmarkState& state) { benchEncodePngBands(state, 4096, 2048, 256); });
+  SHADEY_REGISTER_BENCHMARK("apng/512x512x30",             [](BenchmarkState& state) { benchEncodeApng(state, 512, 512, 30); });
+
+  SHADEY_REGISTER_BENCHMARK("vktype/VkApplicationInfo",    [](BenchmarkState& state) { benchLookupVulkanType(state, "VkApplicationInfo", true); });
+  SHADEY_REGISTER_BENCHMARK("vktype/VkGraphicsPipelineCreateInfo", [](BenchmarkState& state) { benchLookupVulkanType(state, "VkGraphicsPipelineCreateInfo", true); });
+  SHADEY_REGISTER_BENCHMARK("vktype/load",                 [](BenchmarkState& state) { benchLoadVulkanRegistry(state); });
+  SHADEY_REGISTER_BENCHMARK("vktype/miss",                 [](BenchmarkState& state) { benchLookupVulkanType(state, "VkNotARealType", false); });
+  SHADEY_REGISTER_BENCHMARK("vktype/suggest",              [](BenchmarkState& state) { benchSuggestVulkanType(state, "VkPhysicalDeviceFeature"); });
+  SHADEY_REGISTER_BENCHMARK("vktype/search/prefix",        [](BenchmarkState& state) { benchSearchVulkanType(state, "VkPhysicalDevice*Features"); });
+  SHADEY_REGISTER_BENCHMARK("vktype/search/infix",         [](BenchmarkState& state) { benchSearchVulkanType(state, "*RayTracing*"); });
+
+  SHADEY_REGISTER_BENCHMARK("extract/glsl/short",          [](BenchmarkState& state) { benchExtractShaderProgram(state, g_shortMessage); });
+  SHADEY_REGISTER_BENCHMARK("extract/glsl/long",           [](BenchmarkState& state) { benchExtractShaderProgram(state, g_longMessage); });
+  SHADEY_REGISTER_BENCHMARK("extract/hlsl/long",           [](BenchmarkState& state) { benchExtractShaderProgram(state, g_hlslMessage); });
+  SHADEY_REGISTER_BENCHMARK("extract/glsl/stages",         [](BenchmarkState& state) { benchExtractShaderProgram(state, g_stageMessage); });
+
+  SHADEY_REGISTER_BENCHMARK("command/args",                [](BenchmarkState& state) { benchCommandArgs(state, g_benchMessage); });
+  SHADEY_REGISTER_BENCHMARK("command/name",                [](BenchmarkState& state) { benchCommandName(state, g_benchMessage); });
+  SHADEY_REGISTER_BENCHMARK("command/name/chat",           [](BenchmarkState& state) { benchCommandName(state, g_chatMessage); });
+
+}
\ No newline at end of file
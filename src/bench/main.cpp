@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "json_helpers.h"
+#include "shader_cache.h"
+
+// Runs the micro-benchmarks and prints the results as JSON on stdout,
+// so runs from different commits can be diffed by a script.
+
+namespace shadey {
+
+  namespace {
+    static std::atomic<uint64_t> g_allocations = 0;
+
+    static constexpr std::string_view g_usage =
+      "Usage: shadey-bench [--filter <substring>] [--min-time-ms <n>] [--samples <n>] [--label <text>] [--list]\n";
+
+    // No single sample gets more iterations than this, however fast it is.
+    static constexpr uint64_t g_maxIterations = 1'000'000'000;
+
+    struct BenchCliOptions {
+      std::string filter;
+      std::string label;
+      uint32_t    minTimeMs = 500;
+      uint32_t    samples   = 5;
+      bool        list      = false;
+    };
+
+    struct BenchmarkResult {
+      std::string         name;
+      std::string         skipReason;
+      std::string         error;
+      uint64_t            iterations = 0;
+      std::vector<double> nsPerOp;
+      uint64_t            bytes = 0;
+      uint64_t            items = 0;
+      double              allocationsPerOp = 0.0;
+    };
+
+    static bool parseNumber(std::string_view str, uint32_t& value) {
+      auto [end, error] = std::from_chars(str.data(), str.data() + str.length(), value);
+      return error == std::errc() && end == str.data() + str.length();
+    }
+
+    static bool parseArgs(int argc, char** argv, BenchCliOptions& options) {
+      for (int i = 1; i < argc; i++) {
+        const std::string_view arg  = argv[i];
+        const bool             more = i + 1 < argc;
+
+        if (arg == "--filter" && more)
+          options.filter = argv[++i];
+        else if (arg == "--label" && more)
+          options.label = argv[++i];
+        else if (arg == "--min-time-ms" && more) {
+          if (!parseNumber(argv[++i], options.minTimeMs))
+            return false;
+        }
+        else if (arg == "--samples" && more) {
+          if (!parseNumber(argv[++i], options.samples) || options.samples == 0)
+            return false;
+        }
+        else if (arg == "--list")
+          options.list = true;
+        else
+          return false;
+      }
+
+      return true;
+    }
+
+    static BenchmarkResult runBenchmark(const Benchmark& benchmark, const BenchCliOptions& options) {
+      BenchmarkResult result = { .name = benchmark.name };
+
+      try {
+        // Grow the iteration count until one sample takes its share of the minimum time.
+        const double targetNs   = double(options.minTimeMs) * 1'000'000.0 / double(options.samples);
+        uint64_t     iterations = 1;
+
+        for (;;) {
+          BenchmarkState state(iterations);
+          benchmark.func(state);
+
+          if (!state.skipReason().empty()) {
+            result.skipReason = state.skipReason();
+            return result;
+          }
+
+          const double elapsedNs = state.elapsed().count();
+          if (elapsedNs >= targetNs || iterations >= g_maxIterations)
+            break;
+
+          // Aim a little past the target, but never more than 10x per step.
+          const double scale = elapsedNs > 0.0 ? targetNs * 1.2 / elapsedNs : 10.0;
+          iterations = std::min<uint64_t>(g_maxIterations, std::max<uint64_t>(iterations + 1, uint64_t(double(iterations) * std::min(scale, 10.0))));
+        }
+
+        result.iterations = iterations;
+        for (uint32_t i = 0; i < options.samples; i++) {
+          BenchmarkState state(iterations);
+          benchmark.func(state);
+
+          result.nsPerOp.push_back(state.elapsed().count() / double(iterations));
+          result.bytes = state.bytesProcessed();
+          result.items = state.itemsProcessed();
+          result.allocationsPerOp = double(state.allocations()) / double(iterations);
+        }
+      }
+      catch (const std::exception& e) {
+        result.error = e.what();
+      }
+
+      return result;
+    }
+
+    static void writeResult(std::ostream& stream, const BenchmarkResult& result) {
+      stream << "    { \"name\": " << jsonString(result.name);
+
+      if (!result.skipReason.empty()) {
+        stream << ", \"skipped\": " << jsonString(result.skipReason) << " }";
+        return;
+      }
+
+      if (!result.error.empty()) {
+        stream << ", \"error\": " << jsonString(result.error) << " }";
+        return;
+      }
+
+      std::vector<double> sorted = result.nsPerOp;
+      std::sort(sorted.begin(), sorted.end());
+
+      double mean = 0.0;
+      for (double ns : sorted)
+        mean += ns;
+      mean /= double(sorted.size());
+
+      double variance = 0.0;
+      for (double ns : sorted)
+        variance += (ns - mean) * (ns - mean);
+      variance /= double(sorted.size());
+
+      const double median = sorted.size() % 2
+        ? sorted[sorted.size() / 2]
+        : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2.0;
+
+      stream << ", \"iterations\": " << result.iterations
+             << ", \"samples\": " << sorted.size()
+             << ", \"ns_per_op\": { \"min\": " << sorted.front()
+             << ", \"median\": " << median
+             << ", \"mean\": " << mean
+             << ", \"stddev\": " << std::sqrt(variance) << " }"
+             << ", \"allocations_per_op\": " << result.allocationsPerOp;
+
+      // Throughput from the median, so one noisy sample doesn't move it.
+      if (result.bytes)
+        stream << ", \"bytes_per_second\": " << double(result.bytes) * 1e9 / median;
+
+      if (result.items)
+        stream << ", \"items_per_second\": " << double(result.items) * 1e9 / median;
+
+      stream << " }";
+    }
+  }
+
+  uint64_t allocationCount() {
+    return g_allocations.load(std::memory_order_relaxed);
+  }
+
+
+  BenchmarkRegistry* BenchmarkRegistry::instance() {
+    static std::unique_ptr<BenchmarkRegistry> s_instance =
+      std::make_unique<BenchmarkRegistry>();
+
+    return s_instance.get();
+  }
+
+
+  bool BenchmarkRegistry::add(std::string name, BenchmarkFunc func) {
+    m_benchmarks.push_back({ std::move(name), std::move(func) });
+    return true;
+  }
+
+
+  static int runBenchCli(int argc, char** argv) {
+    BenchCliOptions options;
+    if (!parseArgs(argc, argv, options)) {
+      std::cerr << g_usage;
+      return 2;
+    }
+
+    std::vector<const Benchmark*> selected;
+    for (const auto& benchmark : BenchmarkRegistry::instance()->benchmarks()) {
+      if (benchmark.name.find(options.filter) != std::string::npos)
+        selected.push_back(&benchmark);
+    }
+
+    if (options.list) {
+      for (const auto* benchmark : selected)
+        std::cout << benchmark->name << "\n";
+      return 0;
+    }
+
+    // Compiles would otherwise leave SPIR-V lying around in the working directory.
+    ShaderCache::instance()->setDiskDirectory("");
+
+    char date[32] = { };
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n";
+    std::cout << "  \"context\": { \"label\": " << jsonString(options.label)
+              << ", \"date\": " << jsonString(date)
+              << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+              << ", \"min_time_ms\": " << options.minTimeMs
+              << ", \"samples\": " << options.samples << " },\n";
+    std::cout << "  \"benchmarks\": [\n";
+
+    bool failed = false;
+    for (size_t i = 0; i < selected.size(); i++) {
+      std::cerr << "Running " << selected[i]->name << std::endl;
+
+      const BenchmarkResult result = runBenchmark(*selected[i], options);
+      failed |= !result.error.empty();
+
+      writeResult(std::cout, result);
+      std::cout << (i + 1 < selected.size() ? "," : "") << "\n" << std::flush;
+    }
+
+    std::cout << "  ]\n";
+    std::cout << "}\n";
+
+    return failed ? 1 : 0;
+  }
+
+}
+
+// Counting every allocation makes per-op allocation counts part of the results.
+void* operator new(std::size_t size) {
+  shadey::g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  if (void* ptr = std::malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+int main(int argc, char** argv) {
+  return shadey::runBenchCli(argc, argv);
+}
\ No newline at end of file
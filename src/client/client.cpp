@@ -1,12 +1,42 @@
 #include "client.h"
 #include "hooks.h"
+#include "device_scheduler.h"
 
 #include "string_helpers.h"
 
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
 namespace shadey {
 
+  namespace {
+    // sleepy-discord can only upload from a path, so stage uploads on a
+    // RAM-backed filesystem when there is one and remove them straight after.
+    static const std::filesystem::path& uploadDirectory() {
+      static const std::filesystem::path s_directory = [] {
+        std::error_code ec;
+        if (std::filesystem::is_directory("/dev/shm", ec))
+          return std::filesystem::path("/dev/shm");
+
+        return std::filesystem::temp_directory_path(ec);
+      }();
+
+      return s_directory;
+    }
+  }
+
   void ShadeyClient::onReady(SleepyDiscord::Ready ready) {
     m_self = ready.user;
+
+    try {
+      DeviceScheduler::create();
+    }
+    catch (const std::exception& e) {
+      std::cout << "Failed to open render devices: " << e.what() << std::endl;
+    }
+
     updateStatus("Vulkan 1.1");
   }
 
@@ -15,27 +45,54 @@ namespace shadey {
       if (message.author.ID == m_self.ID)
         return;
 
-      auto& hooks = ShadeyGlobalHookList::instance()->hooks();
-      for (auto& hook : hooks)
-        hook->onMessage(*this, message);
+      ShadeyGlobalHookList::instance()->dispatch(*this, message);
+    }
+    catch (const std::exception& e) {
+      reportException(message.channelID, e);
+    }
+  }
+
+
+  void ShadeyClient::reportException(SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, const std::exception& e) {
+    std::string exception = e.what();
+
+    if (exception.length() > 1500)
+      exception = exception.substr(0, 1500);
+
+    std::string error = "An exception occured: ```" + exception + "```";
+
+    std::cout << error << std::endl;
+
+    try {
+      sendMessage(channelID, error);
     }
     catch (const std::exception& e) {
-      std::string exception = e.what();
+      // Do nothing.
+    }
+  }
 
-      if (exception.length() > 1500)
-        exception = exception.substr(0, 1500);
 
-      std::string error = "An exception occured: ```" + exception + "```";
+  void ShadeyClient::uploadBuffer(SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, const std::vector<uint8_t>& data, std::string_view extension) {
+    thread_local std::mt19937_64 s_random(std::random_device{}());
 
-      std::cout << error << std::endl;
+    char name[64];
+    snprintf(name, sizeof(name), "shadey-%016llx%.*s",
+      static_cast<unsigned long long>(s_random()), int(extension.length()), extension.data());
 
-      try {
-        sendMessage(message.channelID, error);
-      }
-      catch (const std::exception& e) {
-        // Do nothing.
-      }
+    const std::filesystem::path path = uploadDirectory() / name;
+
+    struct Remover {
+      const std::filesystem::path& path;
+      ~Remover() { std::error_code ec; std::filesystem::remove(path, ec); }
+    } remover = { path };
+
+    {
+      std::ofstream file(path, std::ios::binary | std::ios::trunc);
+      if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+        throw std::runtime_error("Failed to stage upload");
     }
+
+    uploadFile(channelID, path.string(), "");
   }
 
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include "sleepy_discord/websocketpp_websocket.h"
 
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
 namespace shadey {
 
   class ShadeyClient : public SleepyDiscord::DiscordClient {
@@ -11,6 +15,12 @@ namespace shadey {
     void onReady(SleepyDiscord::Ready ready) override;
     void onMessage(SleepyDiscord::Message message) override;
 
+    // Uploads an in-memory file, the extension decides how Discord shows it.
+    void uploadBuffer(SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, const std::vector<uint8_t>& data, std::string_view extension);
+
+    // Logs the exception and posts it to the channel, for work that ran off the gateway thread.
+    void reportException(SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, const std::exception& e);
+
   private:
     SleepyDiscord::User m_self;
   };
@@ -5,6 +5,7 @@
 #include <string_view>
 
 #include "sleepy_discord/message.h"
+#include "command_parser.h"
 #include "hooks.h"
 
 namespace shadey {
@@ -15,7 +16,7 @@ namespace shadey {
 
   public:
 
-    ShadeyCommandContext(ShadeyClient& client, SleepyDiscord::Message& message);
+    ShadeyCommandContext(ShadeyClient& client, const SleepyDiscord::Message& message);
 
     std::vector<std::string_view> args() const;
 
@@ -23,28 +24,31 @@ namespace shadey {
 
     std::string_view command() const;
 
-    SleepyDiscord::Message& message() const;
+    const SleepyDiscord::Message& message() const;
 
     ShadeyClient& client() const;
 
   private:
 
-    SleepyDiscord::Message& m_message;
+    const SleepyDiscord::Message& m_message;
 
     ShadeyClient& m_client;
   };
 
   class ShadeyCommand : public ShadeyHook {
   public:
-    ShadeyCommand(std::string_view commandName);
+    // Extra names are aliases, e.g. ShadeyCommand("vktype", "vk").
+    template <typename... Aliases>
+    ShadeyCommand(std::string_view commandName, Aliases... aliases)
+      : m_names{ commandName, std::string_view(aliases)... } { }
 
     virtual void onCommand(const ShadeyCommandContext& ctx) = 0;
 
-    void onMessage(ShadeyClient& client, SleepyDiscord::Message message) final;
+    const std::vector<std::string_view>& names() const { return m_names; }
 
   private:
 
-    std::string_view m_commandName;
+    std::vector<std::string_view> m_names;
   };
 
   inline bool contains(const std::string& str, std::string_view substr) {
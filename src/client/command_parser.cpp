@@ -0,0 +1,177 @@
+#include "command_parser.h"
+
+#include <stdexcept>
+
+namespace shadey {
+
+  namespace {
+    static constexpr std::string_view g_commandPrefix = ">";
+
+    // A code block can follow the command on the next line.
+    static constexpr std::string_view g_argDelims = " \t\r\n";
+
+    static constexpr std::string_view g_codeFence = "```";
+
+    static std::vector<std::string_view> splitStringView(std::string_view strv, std::string_view delims = " ") {
+      std::vector<std::string_view> output;
+      size_t first = 0;
+
+      while (first < strv.size()) {
+        const auto second = strv.find_first_of(delims, first);
+
+        // Runs of delimiters don't make empty arguments.
+        if (first != second)
+          output.emplace_back(strv.substr(first, second - first));
+
+        if (second == std::string_view::npos)
+          break;
+
+        first = second + 1;
+      }
+
+      return output;
+    }
+
+    // Shared code goes after any #version line, which has to come first.
+    static std::string joinShaderSource(std::string_view common, std::string_view stage) {
+      if (common.empty())
+        return std::string(stage);
+
+      size_t split = 0;
+      const size_t version = stage.find("#version");
+      if (version != std::string_view::npos) {
+        const size_t lineEnd = stage.find('\n', version);
+        split = lineEnd != std::string_view::npos ? lineEnd + 1 : stage.length();
+      }
+
+      std::string source;
+      source.reserve(stage.length() + common.length() + 2);
+      source.append(stage.substr(0, split));
+      if (split != 0 && source.back() != '\n')
+        source += '\n';
+      source.append(common);
+      source += '\n';
+      source.append(stage.substr(split));
+      return source;
+    }
+  }
+
+  std::vector<std::string_view> splitCommandArgs(std::string_view content) {
+    return splitStringView(content, g_argDelims);
+  }
+
+
+  std::string_view commandArgsString(std::string_view content) {
+    const auto space = content.find_first_of(' ');
+
+    return space == std::string_view::npos
+      ? ""
+      : content.substr(space + 1);
+  }
+
+
+  std::string_view parseCommandName(std::string_view content) {
+    if (!content.starts_with(g_commandPrefix))
+      return "";
+
+    content = content.substr(g_commandPrefix.length());
+
+    const auto space = content.find_first_of(g_argDelims);
+
+    return space == std::string_view::npos
+      ? content.substr(0)
+      : content.substr(0, space);
+  }
+
+
+  std::vector<CodeBlock> extractCodeBlocks(std::string_view message) {
+    std::vector<CodeBlock> blocks;
+
+    size_t pos = 0;
+    while ((pos = message.find(g_codeFence, pos)) != std::string_view::npos) {
+      const size_t infoStart = pos + g_codeFence.length();
+      const size_t close     = message.find(g_codeFence, infoStart);
+
+      // Unterminated, so neither it nor anything after it is a block.
+      if (close == std::string_view::npos)
+        break;
+
+      std::string_view body = message.substr(infoStart, close - infoStart);
+      std::string_view info;
+
+      // The info string runs to the end of the line, or to the first
+      // space for blocks that open and close on the same line.
+      const size_t newline = body.find('\n');
+      const size_t infoEnd = newline != std::string_view::npos ? newline : body.find(' ');
+      if (infoEnd != std::string_view::npos) {
+        info = body.substr(0, infoEnd);
+        body = body.substr(infoEnd + 1);
+      }
+      else {
+        info = body;
+        body = { };
+      }
+
+      while (!info.empty() && (info.back() == ' ' || info.back() == '\t' || info.back() == '\r'))
+        info.remove_suffix(1);
+
+      blocks.push_back({ info, body });
+      pos = close + g_codeFence.length();
+    }
+
+    return blocks;
+  }
+
+
+  bool extractShaderProgram(std::string_view message, ShaderProgram& program) {
+    enum Stage { Stage_Fragment, Stage_Vertex, Stage_Common, Stage_Count };
+
+    std::string_view stages[Stage_Count] = { };
+    bool             hlsl                = false;
+    bool             found               = false;
+
+    for (const auto& block : extractCodeBlocks(message)) {
+      const auto words = splitStringView(block.info, g_argDelims);
+      if (words.empty() || (words[0] != "glsl" && words[0] != "hlsl"))
+        continue;
+
+      Stage            stage = Stage_Fragment;
+      std::string_view code  = block.code;
+      if (words.size() > 1) {
+        if (words[1] == "vert" || words[1] == "vertex")
+          stage = Stage_Vertex;
+        else if (words[1] == "common" || words[1] == "shared")
+          stage = Stage_Common;
+        else if (words[1] != "frag" && words[1] != "fragment") {
+          // Not a stage, just code straight after the language. Both views
+          // point into the message, so the code runs from there to the fence.
+          const char* start = words[0].data() + words[0].length();
+          code = std::string_view(start, size_t(block.code.data() + block.code.length() - start));
+        }
+      }
+
+      if (!stages[stage].empty() || code.empty())
+        continue;
+
+      const bool blockHlsl = words[0] == "hlsl";
+      if (found && blockHlsl != hlsl)
+        throw std::runtime_error("Can't mix GLSL and HLSL blocks in one shader");
+
+      hlsl          = blockHlsl;
+      found         = true;
+      stages[stage] = code;
+    }
+
+    if (stages[Stage_Fragment].empty())
+      return false;
+
+    program.hlsl     = hlsl;
+    program.fragment = joinShaderSource(stages[Stage_Common], stages[Stage_Fragment]);
+    program.vertex   = stages[Stage_Vertex].empty()
+      ? std::string()
+      : joinShaderSource(stages[Stage_Common], stages[Stage_Vertex]);
+
+    return true;
+  }
+
+}
\ No newline at end of file
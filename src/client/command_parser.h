@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "shader_helpers.h"
+
+namespace shadey {
+
+  // Message parsing shared by the commands, kept free of Discord types
+  // so the offline tools can use it too.
+
+  // Splits a message into arguments, the command itself included.
+  std::vector<std::string_view> splitCommandArgs(std::string_view content);
+
+  // Everything after the first space.
+  std::string_view commandArgsString(std::string_view content);
+
+  // The command name after the prefix, empty if the message isn't a command.
+  std::string_view parseCommandName(std::string_view content);
+
+  struct CodeBlock {
+    // Everything after the opening fence on its line, e.g. "glsl vert".
+    std::string_view info;
+    std::string_view code;
+  };
+
+  // Finds every fenced block in one walk over the message.
+  // Views point into the message, nothing is copied.
+  std::vector<CodeBlock> extractCodeBlocks(std::string_view message);
+
+  // Builds a program from the ```glsl / ```hlsl blocks in a message.
+  //
+  // A second word on the fence picks the stage: `frag` (the default), `vert`,
+  // or `common` for code shared by both stages. The first block for each stage
+  // wins, and a fragment block is required.
+  bool extractShaderProgram(std::string_view message, ShaderProgram& program);
+
+}
\ No newline at end of file
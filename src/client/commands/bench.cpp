@@ -0,0 +1,146 @@
+#include "hooks.h"
+#include "command_helpers.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "device_scheduler.h"
+#include "executor.h"
+#include "renderer.h"
+#include "render_context.h"
+#include "render_queue.h"
+
+namespace shadey {
+
+  namespace {
+    static constexpr uint32_t g_defaultIterations = 16;
+    static constexpr uint32_t g_maxIterations     = 256;
+
+    static constexpr std::string_view g_benchUsage = "Usage: `>bench [iterations] [WxH]` followed by a ```glsl or ```hlsl block";
+
+    static bool parseNumber(std::string_view str, uint32_t& value) {
+      auto [end, error] = std::from_chars(str.data(), str.data() + str.length(), value);
+      return error == std::errc() && end == str.data() + str.length();
+    }
+  }
+
+  class BenchCommand : public ShadeyCommand {
+  public:
+    using ShadeyCommand::ShadeyCommand;
+
+    void onCommand(const ShadeyCommandContext& ctx) override {
+      ShaderProgram program;
+      if (!extractShaderProgram(ctx.message().content, program)) {
+        reply(ctx, std::string(g_benchUsage));
+        return;
+      }
+
+      uint32_t iterations = g_defaultIterations;
+      uint32_t width      = 0;
+      uint32_t height     = 0;
+
+      auto args = ctx.args();
+      for (size_t i = 1; i < args.size(); i++) {
+        const std::string_view arg = args[i];
+
+        // Arguments stop where the code block starts.
+        if (arg.starts_with("```"))
+          break;
+
+        const size_t x  = arg.find('x');
+        const bool   ok = x != std::string_view::npos
+          ? parseNumber(arg.substr(0, x), width) && parseNumber(arg.substr(x + 1), height)
+          : parseNumber(arg, iterations);
+
+        if (!ok) {
+          reply(ctx, std::string(g_benchUsage));
+          return;
+        }
+      }
+
+      iterations = std::clamp(iterations, 1u, g_maxIterations);
+
+      auto& message = ctx.message();
+      const bool queued = RenderQueue::instance()->enqueue(message.channelID.string(), message.author.ID.string(),
+        [&client = ctx.client(), channelID = message.channelID, program = std::move(program), iterations, width, height] {
+          return run(client, channelID, program, iterations, width, height);
+        });
+
+      if (!queued)
+        reply(ctx, "I'm busy rendering other shaders right now, try again in a bit!");
+    }
+
+  private:
+
+    static Task<> run(ShadeyClient& client, SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, ShaderProgram program, uint32_t iterations, uint32_t width, uint32_t height) {
+      std::string report;
+      try {
+        client.sendTyping(channelID);
+
+        Renderer renderer(DeviceScheduler::get().pick());
+        report = formatResult(co_await renderer.bench(std::move(program), iterations, width, height));
+      }
+      catch (const std::exception& e) {
+        client.reportException(channelID, e);
+        co_return;
+      }
+
+      co_await Executor::io()->schedule();
+
+      try {
+        client.sendMessage(channelID, report);
+      }
+      catch (const std::exception& e) {
+        // Do nothing.
+      }
+    }
+
+
+    static std::string formatResult(const RendererBenchResult& result) {
+      std::vector<double> times = result.gpuMs;
+      std::sort(times.begin(), times.end());
+
+      // Nearest rank, so p95 of a handful of draws is just the slowest.
+      auto percentile = [&](double p) {
+        const size_t rank = size_t(std::ceil(p * double(times.size())));
+        return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+      };
+
+      std::stringstream stream;
+      stream << std::fixed << std::setprecision(3);
+      stream << "```\n";
+      stream << "Bench " << result.width << "x" << result.height << ", " << times.size() << " draws\n";
+      stream << "  gpu min:     " << times.front() << " ms\n";
+      stream << "  gpu median:  " << percentile(0.5) << " ms\n";
+      stream << "  gpu p95:     " << percentile(0.95) << " ms\n";
+
+      const char* invocationLabel = result.compute ? "  invocations: " : "  fragments:   ";
+
+      if (!result.invocations.empty()) {
+        std::vector<uint64_t> invocations = result.invocations;
+        std::sort(invocations.begin(), invocations.end());
+
+        const uint64_t median = invocations[invocations.size() / 2];
+        const double   pixels = double(result.width) * double(result.height);
+
+        stream << invocationLabel << median << " per draw (" << std::setprecision(2) << double(median) / pixels << " per pixel)\n";
+        stream << std::setprecision(3);
+      }
+      else {
+        stream << invocationLabel << "not supported on this GPU\n";
+      }
+
+      stream << "  compile:     " << result.compileMs << " ms\n";
+      stream << "  pipeline:    " << result.pipelineMs << " ms\n";
+      stream << "```";
+
+      return stream.str();
+    }
+  };
+
+  SHADEY_REGISTER_HOOK(BenchCommand, "bench");
+
+}
\ No newline at end of file
@@ -1,7 +1,12 @@
 #include "hooks.h"
 #include "command_helpers.h"
 
+#include "device_scheduler.h"
 #include "renderer.h"
+#include "render_context.h"
+#include "render_queue.h"
+#include "executor.h"
+#include "result_cache.h"
 #include "string_helpers.h"
 
 namespace shadey {
@@ -10,46 +15,80 @@ namespace shadey {
   public:
     using ShadeyHook::ShadeyHook;
 
-    void onMessage(ShadeyClient& client, SleepyDiscord::Message message) final {
-      // Extract the code from the message.
-      std::string code;
-      bool hlsl = false;
-      {
-        std::string content = message.content;
-
-        size_t codeStart = content.find("```glsl");
-        if (codeStart == std::string::npos) {
-          hlsl = true;
-          codeStart = content.find("```hlsl");
+    static Task<std::vector<uint8_t>> render(ShaderProgram program) {
+      Renderer renderer(DeviceScheduler::get().pick());
+      co_return co_await renderer.render(std::move(program));
+    }
 
-          if (codeStart == std::string::npos)
-            return;
-        }
 
-        content = content.substr(codeStart + strlen("```glsl"));
+    static Task<> upload(ShadeyClient& client, SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, EncodedImage image) {
+      // Uploads block on the network, keep them off the render threads.
+      co_await Executor::io()->schedule();
 
-        size_t codeEnd = content.find("```", codeStart);
+      try {
+        client.uploadBuffer(channelID, *image, ".png");
+      }
+      catch (const std::exception& e) {
+        client.reportException(channelID, std::runtime_error("File was too big to upload!"));
+      }
+    }
 
-        if (codeEnd == std::string::npos)
-          return;
 
-        code = content.substr(0, codeEnd);
+    static Task<> renderAndUpload(ShadeyClient& client, SleepyDiscord::Snowflake<SleepyDiscord::Channel> channelID, ShaderProgram program, Hash128 key) {
+      EncodedImage image;
+      std::string  note;
+      try {
+        client.sendTyping(channelID);
 
-        if (code.empty())
-          return;
+        // Identical shaders already rendering are joined rather than rendered again.
+        image = co_await ResultCache::instance()->findOrRender(key, [&program] { return render(program); });
+      }
+      catch (const PartialRenderError& e) {
+        // Still worth showing, but never cached, so a repost gets another go.
+        image = std::make_shared<const std::vector<uint8_t>>(e.png());
+        note  = e.what();
+      }
+      catch (const std::exception& e) {
+        client.reportException(channelID, e);
+        co_return;
       }
 
-      client.sendTyping(message.channelID);
+      co_await upload(client, channelID, std::move(image));
 
-      Renderer renderer;
-      std::string filename = renderer.init(hlsl, code);
+      if (!note.empty())
+        client.sendMessage(channelID, note);
+    }
 
-      try {
-        client.uploadFile(message.channelID, filename, "");
-      }
-      catch (const std::exception& e) {
-        throw std::runtime_error("File was too big to upload!");
+    bool wantsMessage(std::string_view content) const final {
+      // Commands that take a shader deal with it themselves.
+      return !content.starts_with(">") && content.find("```") != std::string_view::npos;
+    }
+
+    void onMessage(ShadeyClient& client, const SleepyDiscord::Message& message) final {
+      // The one copy of the code, the render outlives the message.
+      ShaderProgram program;
+      if (!extractShaderProgram(message.content, program))
+        return;
+
+      Renderer::fixCode(program);
+
+      const RendererOptions options = Renderer::getRendererOptions(program.fragment);
+      const Hash128         key     = ResultCache::key(program, options);
+
+      // Reposts skip the render queue entirely.
+      if (auto image = ResultCache::instance()->find(key)) {
+        spawn(upload(client, message.channelID, std::move(image)));
+        return;
       }
+
+      // Rendering happens on the render queue's executor, never on the gateway thread.
+      const bool queued = RenderQueue::instance()->enqueue(message.channelID.string(), message.author.ID.string(),
+        [&client, channelID = message.channelID, program = std::move(program), key] {
+          return renderAndUpload(client, channelID, program, key);
+        });
+
+      if (!queued)
+        client.sendMessage(message.channelID, "I'm busy rendering other shaders right now, try again in a bit!");
     }
   };
 
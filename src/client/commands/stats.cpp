@@ -0,0 +1,91 @@
+#include "hooks.h"
+#include "command_helpers.h"
+
+#include <iomanip>
+#include <sstream>
+
+#include "device_scheduler.h"
+#include "shader_cache.h"
+#include "render_context.h"
+#include "render_queue.h"
+#include "result_cache.h"
+
+namespace shadey {
+
+  class StatsCommand : public ShadeyCommand {
+  public:
+    using ShadeyCommand::ShadeyCommand;
+
+    void onCommand(const ShadeyCommandContext& ctx) override {
+      std::stringstream stream;
+      stream << "```\n";
+
+      {
+        auto stats = ShaderCache::instance()->stats();
+
+        const uint64_t lookups = stats.memoryHits + stats.diskHits + stats.misses;
+        const double   hitRate = lookups ? 100.0 * double(stats.memoryHits + stats.diskHits) / double(lookups) : 0.0;
+
+        stream << "Shader cache\n";
+        stream << "  hits:      " << stats.memoryHits << " memory, " << stats.diskHits << " disk\n";
+        stream << "  misses:    " << stats.misses << "\n";
+        stream << "  hit rate:  " << std::fixed << std::setprecision(1) << hitRate << "%\n";
+        stream << "  entries:   " << stats.entries << " (" << stats.evictions << " evicted)\n";
+        stream << "  size:      " << stats.bytes / 1024 << " / " << stats.maxBytes / 1024 << " KiB\n";
+        stream << "  disk:      " << stats.diskBytes / 1024 << " / " << stats.maxDiskBytes / 1024 << " KiB (" << stats.diskEvictions << " evicted)\n";
+      }
+
+      {
+        auto stats = ResultCache::instance()->stats();
+
+        stream << "Result cache\n";
+        stream << "  hits:      " << stats.hits << " (" << stats.coalesced << " joined a running render)\n";
+        stream << "  misses:    " << stats.misses << "\n";
+        stream << "  entries:   " << stats.entries << " (" << stats.evictions << " evicted)\n";
+        stream << "  size:      " << stats.bytes / 1024 << " / " << stats.maxBytes / 1024 << " KiB\n";
+      }
+
+      {
+        auto stats = RenderQueue::instance()->stats();
+
+        stream << "Render queue\n";
+        stream << "  queued:    " << stats.queued << " / " << stats.capacity << " (" << stats.perUserLimit << " per user)\n";
+        stream << "  running:   " << stats.running << " / " << stats.maxRunning << "\n";
+        stream << "  completed: " << stats.completed << ", rejected: " << stats.rejected << "\n";
+      }
+
+      try {
+        const auto& devices = DeviceScheduler::get().devices();
+
+        for (size_t i = 0; i < devices.size(); i++) {
+          RenderContext& device = *devices[i];
+
+          auto load    = device.load();
+          auto targets = device.targetPool().stats();
+          auto queue   = device.gpuQueue().stats();
+
+          stream << "Device " << i << ": " << device.deviceName() << " (" << device.deviceTypeName() << (device.lost() ? ", lost" : "") << ")\n";
+          stream << "  load:      " << load.activeJobs << " running, " << load.jobs << " total, "
+                 << std::fixed << std::setprecision(1) << 100.0 * load.utilization << "% busy\n";
+          stream << "  memory:    " << device.freeMemory() / (1024 * 1024) << " / " << device.deviceMemory() / (1024 * 1024) << " MiB free\n";
+          stream << "  targets:   " << targets.hits << " reused, " << targets.misses << " allocated (" << targets.evictions << " evicted)\n";
+          stream << "  live:      " << targets.liveTargets << " (" << targets.liveBytes / 1024 << " KiB)\n";
+          stream << "  idle:      " << targets.idleTargets << " (" << targets.idleBytes / 1024 << " / " << targets.maxIdleBytes / 1024 << " KiB)\n";
+          stream << "  queue:     " << queue.jobs << " jobs in " << queue.submits << " submits (largest batch " << queue.largestBatch << ")\n";
+          stream << "  sync:      " << (queue.timelineSemaphores ? "timeline semaphores" : "fences") << "\n";
+          stream << "  timeouts:  " << queue.timeouts << "\n";
+        }
+      }
+      catch (const std::exception& e) {
+        stream << "Devices unavailable: " << e.what() << "\n";
+      }
+
+      stream << "```";
+
+      reply(ctx, stream.str());
+    }
+  };
+
+  SHADEY_REGISTER_HOOK(StatsCommand, "stats");
+
+}
\ No newline at end of file
@@ -1,202 +1,78 @@
 #include "hooks.h"
 #include "command_helpers.h"
 #include "string_helpers.h"
-
-#include "tinyxml2.h"
+#include "vulkan_registry.h"
 
 namespace shadey {
 
-  static const tinyxml2::XMLDocument& GetVulkanXML() {
-    static tinyxml2::XMLDocument* doc = nullptr;
+  namespace {
+    static constexpr size_t g_maxSuggestions   = 5;
+    static constexpr size_t g_maxSearchResults = 25;
 
-    if (doc == nullptr) {
-      doc = new tinyxml2::XMLDocument();
-      doc->LoadFile("vk.xml");
+    static std::string displayName(const VulkanRegistry::Match& match) {
+      return match.command
+        ? std::string(match.name) + "()"
+        : std::string(match.name);
     }
-
-    return *doc;
-  }
-
-  const tinyxml2::XMLElement* GetFirstVulkanTypeElement() {
-    const tinyxml2::XMLDocument& doc = GetVulkanXML();
-
-    auto registry = doc.FirstChildElement("registry");
-    if (!registry)
-      return nullptr;
-
-    auto types = registry->FirstChildElement("types");
-    if (!types)
-      return nullptr;
-
-    return types->FirstChildElement("type");
-  }
-
-  bool StringContains(const char* s1, const char* s2) {
-    if (s1 == s2)
-      return true;
-
-    if (s1 == nullptr || s2 == nullptr)
-      return false;
-
-    return strstr(s1, s2);
   }
 
-  const char* PreviousText(const tinyxml2::XMLNode* node) {
-    if (node == nullptr)
-      return nullptr;
-
-    node = node->PreviousSibling();
-
-    if (node == nullptr)
-      return nullptr;
-
-    auto text = node->ToText();
-
-    return text == nullptr
-      ? nullptr
-      : text->Value();
-  }
-
-  void WriteVulkanStruct(const tinyxml2::XMLElement* type, std::stringstream& stream) {
-    const char* name = type->Attribute("name");
-
-    stream << "```cpp\n";
-    stream << "struct " << name << " {" << "\n";
-
-    // Loop through members to find max lengths
-    size_t maxTypeLength = 0;
-    size_t maxNameLength = 0;
-    {
-      auto member = type->FirstChildElement("member");
-      while (member != nullptr) {
-        auto memberType = member->FirstChildElement("type");
-        auto memberName = member->FirstChildElement("name");
+  class VulkanTypeCommand : public ShadeyCommand {
+  public:
+    using ShadeyCommand::ShadeyCommand;
 
-        size_t extraSize = 0;
-        if (StringContains(PreviousText(memberType), "const")) extraSize += 6;
-        if (StringContains(PreviousText(memberName), "*"))     extraSize += 1;
+    void onCommand(const ShadeyCommandContext& ctx) override {
+      auto name = std::string(ctx.argsString());
+      trim(name);
 
-        if (memberType != nullptr && memberName != nullptr) {
-          maxTypeLength = std::max(maxTypeLength, strlen(memberType->GetText()) + extraSize);
-          maxNameLength = std::max(maxNameLength, strlen(memberName->GetText()));
-        }
+      VulkanRegistry* registry = VulkanRegistry::instance();
 
-        member = member->NextSiblingElement("member");
+      if (contains(name, "*")) {
+        replySearch(ctx, registry->search(name), name);
+        return;
       }
-    }
 
-    // Loop through again to output.
-    {
-      auto member = type->FirstChildElement("member");
-      while (member != nullptr) {
-        auto memberType   = member->FirstChildElement("type");
-        auto memberName   = member->FirstChildElement("name");
-        auto memberValues = member->Attribute("values");
-        auto memberOptional = member->Attribute("optional");
-        auto memberLen = member->Attribute("len");
-
-        if (memberType != nullptr && memberName != nullptr) {
-          auto comment = member->FirstChildElement("comment");
-          if (comment != nullptr)
-            stream << "\t// " << comment->GetText() << "\n";
-
-          {
-            bool lengthBased = false;
-            const char *optionalType = NULL;
-            if (memberOptional && !strcmp(memberOptional, "true"))
-              optionalType = "May always be NULL/0.";
-            else if (memberOptional && (!strcmp(memberOptional, "true,false") || !strcmp(memberOptional, "true, false")))
-              optionalType = "Children must be valid";
-            else if (memberOptional && (!strcmp(memberOptional, "false,true") || !strcmp(memberOptional, "false, true")))
-              optionalType = "Optional values, pointer required";
-            else if (memberLen != nullptr){
-              lengthBased = true;
-              optionalType = "May be NULL if ";
-            }
-
-            if (optionalType)
-              stream << "\t// Optional: " << optionalType;
-
-            if (lengthBased)
-              stream << memberLen << " is 0";
-
-            stream << "\n";
-          }
-
-          if (memberLen != nullptr)
-            stream << "\t// Length: " << memberLen << "\n";
-
-          if (memberValues != nullptr)
-            stream << "\t// Values: " << memberValues << "\n";
-
-          stream << "\t";
-          if (StringContains(PreviousText(memberType), "const")) stream << "const ";
-          stream << memberType->GetText();
-          if (StringContains(PreviousText(memberName), "*"))     stream << "*";
-          stream << " ";
-
-          size_t extraSize = 0;
-          if (StringContains(PreviousText(memberType), "const")) extraSize += 6;
-          if (StringContains(PreviousText(memberName), "*"))     extraSize += 1;
-
-          size_t spaces = maxTypeLength - (strlen(memberType->GetText()) + extraSize);
-          for (size_t i = 0; i < spaces; i++)
-            stream << " ";
-
-          stream << "  " << memberName->GetText() << ";";
-
-          stream << "\n";
-        }
-
-        member = member->NextSiblingElement("member");
+      const std::string* definition = registry->find(name);
+      if (!definition) {
+        replyMiss(ctx, registry->suggest(name, g_maxSuggestions), name);
+        return;
       }
-    }
 
-    stream << "};\n";
-    stream << "```";
-  }
+      if (definition->length() > 1500)
+        throw std::runtime_error("Too big, sorry!");
 
-  bool LookupVulkanType(std::string lookupStruct, std::stringstream& stream) {
-    auto type = GetFirstVulkanTypeElement();
-    while (type != nullptr) {
-      const char* category = type->Attribute("category");
-      const char* name     = type->Attribute("name");
+      reply(ctx, *definition);
+    }
 
-      if (category != nullptr && name != nullptr) {
-        if (!strcmp(name, lookupStruct.c_str())) {
-          WriteVulkanStruct(type, stream);
+  private:
 
-          stream << "https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/" << lookupStruct << ".html";
+    void replyMiss(const ShadeyCommandContext& ctx, const std::vector<VulkanRegistry::Match>& suggestions, const std::string& name) {
+      std::string message = "Couldn't find " + name;
 
-          return true;
-        }
+      for (size_t i = 0; i < suggestions.size(); i++) {
+        message += i == 0 ? ", did you mean " : (i + 1 == suggestions.size() ? " or " : ", ");
+        message += "`" + displayName(suggestions[i]) + "`";
       }
+      if (!suggestions.empty())
+        message += "?";
 
-      type = type->NextSiblingElement("type");
+      reply(ctx, message);
     }
 
-    return false;
-  }
-
-  class VulkanTypeCommand : public ShadeyCommand {
-  public:
-    using ShadeyCommand::ShadeyCommand;
-
-    void onCommand(const ShadeyCommandContext& ctx) override {
-      auto name = std::string(ctx.argsString());
-      trim(name);
-
-      std::stringstream stream;
-      if (!LookupVulkanType(name, stream)) {
-        ctx.client().sendMessage(ctx.message().channelID, "Couldn't find " + name);
+    void replySearch(const ShadeyCommandContext& ctx, const std::vector<VulkanRegistry::Match>& matches, const std::string& pattern) {
+      if (matches.empty()) {
+        reply(ctx, "Nothing matches " + pattern);
         return;
       }
 
-      std::string str = stream.str();
-      if (str.length() > 1500)
-        throw std::runtime_error("Too big, sorry!");
+      std::string message = "```\n";
+      for (size_t i = 0; i < std::min(matches.size(), g_maxSearchResults); i++)
+        message += displayName(matches[i]) + "\n";
+      message += "```";
+
+      if (matches.size() > g_maxSearchResults)
+        message += "...and " + std::to_string(matches.size() - g_maxSearchResults) + " more";
 
-      reply(ctx, str);
+      reply(ctx, message);
     }
   };
 
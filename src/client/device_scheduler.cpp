@@ -0,0 +1,184 @@
+#include "device_scheduler.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+
+#include "render_context.h"
+
+namespace shadey {
+
+  namespace {
+    static std::unique_ptr<DeviceScheduler> s_scheduler;
+    static std::once_flag                   s_schedulerOnce;
+
+    // The render queue runs 8 jobs at most, so one GPU can't take them all.
+    static constexpr uint32_t     g_hardwareJobSlots = 4;
+    // Software devices already spread each job over every core.
+    static constexpr uint32_t     g_softwareJobSlots = 2;
+    // Below this a device counts as full whatever its load.
+    static constexpr VkDeviceSize g_minFreeMemory    = 256 * 1024 * 1024;
+
+    static uint32_t typeRank(VkPhysicalDeviceType type) {
+      switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 0;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 1;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return 4;
+        default:                                     return 3;
+      }
+    }
+  }
+
+  DeviceScheduler::DeviceScheduler(const std::string& deviceName) {
+    // Create instance
+    {
+      VkApplicationInfo appInfo = {
+        .sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName   = "Shadey",
+        .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+        .pEngineName        = "Shadey",
+        .engineVersion      = VK_MAKE_VERSION(1, 0, 0),
+        .apiVersion         = VK_API_VERSION_1_2
+      };
+
+      VkInstanceCreateInfo instanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo
+      };
+
+      if (vkCreateInstance(&instanceInfo, nullptr, &m_instance) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create Vulkan instance");
+    }
+
+    // Open everything we can, a device that fails shouldn't take the rest down with it.
+    try {
+      uint32_t deviceCount = 0;
+      vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
+
+      if (deviceCount == 0)
+        throw std::runtime_error("Failed to find any Vulkan capable GPUs");
+
+      std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+      vkEnumeratePhysicalDevices(m_instance, &deviceCount, physicalDevices.data());
+
+      for (uint32_t i = 0; i < deviceCount; i++) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevices[i], &properties);
+
+        if (!deviceName.empty() && std::string_view(properties.deviceName).find(deviceName) == std::string_view::npos)
+          continue;
+
+        try {
+          m_devices.push_back(std::make_unique<RenderContext>(m_instance, physicalDevices[i], i));
+        }
+        catch (const std::exception& e) {
+          std::cout << "Skipping " << properties.deviceName << ": " << e.what() << std::endl;
+        }
+      }
+
+      if (m_devices.empty()) {
+        throw std::runtime_error(deviceName.empty()
+          ? "Failed to open any Vulkan device"
+          : "Failed to find a Vulkan device matching " + deviceName);
+      }
+
+      std::stable_sort(m_devices.begin(), m_devices.end(), [](const auto& a, const auto& b) {
+        const uint32_t rankA = typeRank(a->deviceType());
+        const uint32_t rankB = typeRank(b->deviceType());
+
+        if (rankA != rankB)
+          return rankA < rankB;
+
+        return a->deviceMemory() > b->deviceMemory();
+      });
+    }
+    catch (...) {
+      m_devices.clear();
+      vkDestroyInstance(m_instance, nullptr);
+      throw;
+    }
+  }
+
+
+  DeviceScheduler::~DeviceScheduler() {
+    // Every device has to go before the instance.
+    m_devices.clear();
+
+    if (m_instance != VK_NULL_HANDLE)
+      vkDestroyInstance(m_instance, nullptr);
+  }
+
+
+  void DeviceScheduler::create(const std::string& deviceName) {
+    std::call_once(s_schedulerOnce, [&] {
+      s_scheduler = std::make_unique<DeviceScheduler>(deviceName);
+    });
+  }
+
+
+  DeviceScheduler& DeviceScheduler::get() {
+    if (!s_scheduler)
+      throw std::runtime_error("Renderer is not available");
+
+    return *s_scheduler;
+  }
+
+
+  RenderContext& DeviceScheduler::pick() {
+    // Loads are read one device at a time, so two jobs picking at once
+    // can land on the same device. That only costs a little balance.
+    RenderContext* hardware     = nullptr;
+    uint32_t       hardwareJobs = 0;
+    RenderContext* software     = nullptr;
+    RenderContext* fallback     = nullptr;
+    double         fallbackLoad = 0.0;
+
+    for (auto& device : m_devices) {
+      if (device->lost())
+        continue;
+
+      const uint32_t activeJobs = device->load().activeJobs;
+      const uint32_t slots      = jobSlots(*device);
+
+      // Least loaded for its slots, ties going to the better ranked device.
+      const double load = double(activeJobs) / double(slots);
+      if (!fallback || load < fallbackLoad) {
+        fallback     = device.get();
+        fallbackLoad = load;
+      }
+
+      if (activeJobs >= slots || device->freeMemory() < g_minFreeMemory)
+        continue;
+
+      if (device->software()) {
+        if (!software)
+          software = device.get();
+      }
+      else if (!hardware || activeJobs < hardwareJobs) {
+        hardware     = device.get();
+        hardwareJobs = activeJobs;
+      }
+    }
+
+    if (hardware)
+      return *hardware;
+
+    if (software)
+      return *software;
+
+    if (fallback)
+      return *fallback;
+
+    throw std::runtime_error("Every render device has been lost");
+  }
+
+
+  uint32_t DeviceScheduler::jobSlots(const RenderContext& device) {
+    return device.software() ? g_softwareJobSlots : g_hardwareJobSlots;
+  }
+
+}
\ No newline at end of file
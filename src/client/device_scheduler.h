@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  class RenderContext;
+
+  // Opens a RenderContext on every usable Vulkan device and spreads jobs across them.
+  //
+  // Devices are ranked discrete, integrated, virtual, then software, bigger
+  // heaps first within a type. Each job goes to the least loaded hardware
+  // device with a free slot and some memory to spare. Once every hardware
+  // device is full or lost, jobs spill over to a software device, and only
+  // when that's full too do they queue up behind the least loaded device.
+  class DeviceScheduler : public NonCopyable {
+
+  public:
+
+    // An empty deviceName opens every device, otherwise only those whose name contains it.
+    DeviceScheduler(const std::string& deviceName = "");
+
+    ~DeviceScheduler();
+
+    static void create(const std::string& deviceName = "");
+
+    static DeviceScheduler& get();
+
+    // Where the next job should run. Throws if every device has been lost.
+    RenderContext& pick();
+
+    // The best ranked device.
+    RenderContext& primary() { return *m_devices.front(); }
+
+    // Best ranked first.
+    const std::vector<std::unique_ptr<RenderContext>>& devices() const { return m_devices; }
+
+  private:
+
+    // Jobs a device takes before it counts as full.
+    static uint32_t jobSlots(const RenderContext& device);
+
+    VkInstance                                  m_instance = VK_NULL_HANDLE;
+    std::vector<std::unique_ptr<RenderContext>> m_devices;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace shadey {
+
+  static constexpr uint32_t g_maxRenderThreads = 4;
+  static constexpr uint32_t g_ioThreads        = 4;
+
+  Executor::Executor(uint32_t threadCount)
+    : m_pool(threadCount) {
+  }
+
+
+  Executor* Executor::instance() {
+    // Stages hand off to the GPU and the encoder's pool,
+    // so this only needs enough threads to keep both fed.
+    static std::unique_ptr<Executor> s_instance = std::make_unique<Executor>(
+      std::clamp(std::thread::hardware_concurrency() / 2, 2u, g_maxRenderThreads));
+
+    return s_instance.get();
+  }
+
+
+  Executor* Executor::io() {
+    static std::unique_ptr<Executor> s_instance = std::make_unique<Executor>(g_ioThreads);
+
+    return s_instance.get();
+  }
+
+
+  void Executor::post(std::coroutine_handle<> handle) {
+    m_pool.enqueue([handle] { handle.resume(); });
+  }
+
+}
\ No newline at end of file
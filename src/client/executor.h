@@ -0,0 +1,42 @@
+#pragma once
+
+#include <coroutine>
+
+#include "non_copyable.h"
+#include "thread_pool.h"
+
+namespace shadey {
+
+  // Runs coroutines on a fixed set of threads.
+  // `co_await executor->schedule()` moves the rest of a coroutine onto it.
+  class Executor : public NonCopyable {
+  public:
+    Executor(uint32_t threadCount);
+
+    // Render stages: compilation, pipeline builds, recording and encoding.
+    static Executor* instance();
+
+    // Blocking network work like uploads, so it never holds up rendering.
+    static Executor* io();
+
+    void post(std::coroutine_handle<> handle);
+
+    auto schedule() {
+      struct Awaiter {
+        Executor* executor;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) { executor->post(handle); }
+
+        void await_resume() const noexcept { }
+      };
+
+      return Awaiter{ this };
+    }
+
+  private:
+    ThreadPool m_pool;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,362 @@
+#include "gpu_queue.h"
+#include "executor.h"
+#include "render_context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <stdexcept>
+
+namespace shadey {
+
+  // How long a single wait can hold off waiters that arrived during it.
+  static constexpr uint64_t g_waitSliceNs = 2'000'000;
+
+  GpuQueue::GpuQueue(RenderContext& context, VkQueue queue, bool timelineSemaphores)
+    : m_context(context)
+    , m_device (context.device())
+    , m_queue  (queue) {
+    if (timelineSemaphores) {
+      VkSemaphoreTypeCreateInfo typeInfo = {
+        .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue  = 0
+      };
+
+      VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &typeInfo
+      };
+
+      if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timeline) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create timeline semaphore");
+    }
+
+    m_submitThread = std::thread([this] { submitLoop(); });
+    m_waitThread   = std::thread([this] { waitLoop(); });
+  }
+
+
+  GpuQueue::~GpuQueue() {
+    {
+      std::lock_guard lock(m_submitMutex);
+      m_stopping = true;
+    }
+    m_submitCond.notify_all();
+    m_submitThread.join();
+
+    {
+      std::lock_guard lock(m_waitMutex);
+      m_waitStopping = true;
+    }
+    m_waitCond.notify_all();
+    m_waitThread.join();
+
+    vkQueueWaitIdle(m_queue);
+
+    // Nothing is in flight any more, the context is still alive to take these back.
+    for (auto& deferred : m_deferred)
+      deferred.callback();
+
+    for (auto& batch : m_inFlight)
+      m_context.releaseFence(batch.fence);
+
+    if (m_timeline != VK_NULL_HANDLE)
+      vkDestroySemaphore(m_device, m_timeline, nullptr);
+  }
+
+
+  uint64_t GpuQueue::submit(VkCommandBuffer commandBuffer) {
+    uint64_t value;
+    {
+      std::lock_guard lock(m_submitMutex);
+      value = m_nextValue++;
+      m_queued.push_back({ commandBuffer, value });
+    }
+    m_submitCond.notify_one();
+
+    return value;
+  }
+
+
+  bool GpuQueue::isComplete(uint64_t value) const {
+    if (m_timeline != VK_NULL_HANDLE) {
+      uint64_t counter = 0;
+      return vkGetSemaphoreCounterValue(m_device, m_timeline, &counter) == VK_SUCCESS && counter >= value;
+    }
+
+    return m_completed >= value;
+  }
+
+
+  void GpuQueue::whenComplete(uint64_t value, std::function<void()> callback) {
+    {
+      std::lock_guard lock(m_waitMutex);
+      m_deferred.push_back({ value, std::move(callback) });
+    }
+    m_waitCond.notify_one();
+  }
+
+
+  GpuQueueStats GpuQueue::stats() {
+    return GpuQueueStats {
+      .jobs               = m_jobs,
+      .submits            = m_submits,
+      .largestBatch       = m_largestBatch,
+      .timeouts           = m_timeouts,
+      .timelineSemaphores = m_timeline != VK_NULL_HANDLE,
+    };
+  }
+
+
+  bool GpuQueue::Awaiter::await_ready() {
+    if (queue->isComplete(value)) {
+      result = VK_SUCCESS;
+      return true;
+    }
+
+    // Nothing will complete on a broken queue, fail straight away.
+    result = queue->m_error;
+    return result != VK_SUCCESS;
+  }
+
+
+  void GpuQueue::Awaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    handle = awaiting;
+    {
+      std::lock_guard lock(queue->m_waitMutex);
+      queue->m_waiters.push_back(this);
+    }
+    queue->m_waitCond.notify_one();
+  }
+
+
+  bool GpuQueue::Awaiter::await_resume() {
+    if (result == VK_TIMEOUT)
+      return false;
+
+    if (result != VK_SUCCESS)
+      throw std::runtime_error("Failed to wait for render");
+
+    return true;
+  }
+
+
+  void GpuQueue::submitLoop() {
+    std::vector<Pending> batch;
+
+    for (;;) {
+      {
+        std::unique_lock lock(m_submitMutex);
+        m_submitCond.wait(lock, [this] { return m_stopping || !m_queued.empty(); });
+
+        if (m_queued.empty())
+          return;
+
+        // Everything that piled up while we were last submitting goes out together.
+        batch.swap(m_queued);
+      }
+
+      // The queue is broken, its waiters fail with m_error rather than waiting on work that never went out.
+      if (m_error != VK_SUCCESS) {
+        batch.clear();
+        m_waitCond.notify_one();
+        continue;
+      }
+
+      const VkResult result = flush(batch);
+      if (result != VK_SUCCESS)
+        setError(result);
+
+      m_jobs    += batch.size();
+      m_submits += 1;
+
+      uint32_t largest = m_largestBatch;
+      while (batch.size() > largest && !m_largestBatch.compare_exchange_weak(largest, uint32_t(batch.size())));
+
+      batch.clear();
+    }
+  }
+
+
+  VkResult GpuQueue::flush(const std::vector<Pending>& batch) {
+    if (m_timeline != VK_NULL_HANDLE) {
+      // One submit info per job so each signals its own value.
+      std::vector<VkTimelineSemaphoreSubmitInfo> timelineInfos(batch.size());
+      std::vector<VkSubmitInfo>                  submitInfos(batch.size());
+
+      for (size_t i = 0; i < batch.size(); i++) {
+        timelineInfos[i] = {
+          .sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+          .signalSemaphoreValueCount = 1,
+          .pSignalSemaphoreValues    = &batch[i].value
+        };
+
+        submitInfos[i] = {
+          .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+          .pNext                = &timelineInfos[i],
+          .commandBufferCount   = 1,
+          .pCommandBuffers      = &batch[i].commandBuffer,
+          .signalSemaphoreCount = 1,
+          .pSignalSemaphores    = &m_timeline
+        };
+      }
+
+      return vkQueueSubmit(m_queue, uint32_t(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE);
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers;
+    commandBuffers.reserve(batch.size());
+    for (const auto& pending : batch)
+      commandBuffers.push_back(pending.commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+      .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = uint32_t(commandBuffers.size()),
+      .pCommandBuffers    = commandBuffers.data()
+    };
+
+    VkFence fence = m_context.acquireFence();
+
+    const VkResult result = vkQueueSubmit(m_queue, 1, &submitInfo, fence);
+    if (result != VK_SUCCESS) {
+      m_context.releaseFence(fence);
+      return result;
+    }
+
+    std::lock_guard lock(m_batchMutex);
+    m_inFlight.push_back({ fence, batch.back().value });
+    return VK_SUCCESS;
+  }
+
+
+  uint64_t GpuQueue::waitForValue(uint64_t value, uint64_t timeoutNs) {
+    if (m_timeline != VK_NULL_HANDLE) {
+      VkSemaphoreWaitInfo waitInfo = {
+        .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores    = &m_timeline,
+        .pValues        = &value
+      };
+      const VkResult result = vkWaitSemaphores(m_device, &waitInfo, timeoutNs);
+      if (result < 0)
+        setError(result);
+
+      uint64_t counter = 0;
+      vkGetSemaphoreCounterValue(m_device, m_timeline, &counter);
+      return counter;
+    }
+
+    VkFence oldest = VK_NULL_HANDLE;
+    {
+      std::lock_guard lock(m_batchMutex);
+      if (!m_inFlight.empty())
+        oldest = m_inFlight.front().fence;
+    }
+
+    if (oldest != VK_NULL_HANDLE) {
+      const VkResult result = vkWaitForFences(m_device, 1, &oldest, VK_TRUE, timeoutNs);
+      if (result < 0)
+        setError(result);
+    }
+    else
+      std::this_thread::sleep_for(std::chrono::nanoseconds(timeoutNs));
+
+    // Batches retire strictly in order, so a job never reads as done before earlier ones.
+    std::lock_guard lock(m_batchMutex);
+    while (!m_inFlight.empty() && vkGetFenceStatus(m_device, m_inFlight.front().fence) == VK_SUCCESS) {
+      m_completed = m_inFlight.front().lastValue;
+      m_context.releaseFence(m_inFlight.front().fence);
+      m_inFlight.pop_front();
+    }
+
+    return m_completed;
+  }
+
+
+  void GpuQueue::setError(VkResult result) {
+    // Keep the first, later ones are usually fallout from it.
+    VkResult expected = VK_SUCCESS;
+    m_error.compare_exchange_strong(expected, result);
+
+    m_waitCond.notify_one();
+  }
+
+
+  void GpuQueue::waitLoop() {
+    std::vector<Awaiter*> pending;
+    std::vector<Awaiter*> ready;
+    std::vector<Deferred> deferred;
+
+    for (;;) {
+      {
+        std::unique_lock lock(m_waitMutex);
+        m_waitCond.wait(lock, [this] { return m_waitStopping || !m_waiters.empty() || !m_deferred.empty(); });
+
+        // Anything still waiting at shutdown is left suspended, the destructor runs what's deferred.
+        if (m_waitStopping)
+          return;
+
+        pending.insert(pending.end(), m_waiters.begin(), m_waiters.end());
+        m_waiters.clear();
+
+        deferred.insert(deferred.end(), std::make_move_iterator(m_deferred.begin()), std::make_move_iterator(m_deferred.end()));
+        m_deferred.clear();
+      }
+
+      uint64_t oldest = UINT64_MAX;
+      for (auto* awaiter : pending)
+        oldest = std::min(oldest, awaiter->value);
+
+      for (const auto& entry : deferred)
+        oldest = std::min(oldest, entry.value);
+
+      const uint64_t completed = waitForValue(oldest, g_waitSliceNs);
+      const VkResult error     = m_error;
+      const auto     now       = std::chrono::steady_clock::now();
+
+      ready.clear();
+      std::erase_if(pending, [&](Awaiter* awaiter) {
+        if (awaiter->value <= completed) {
+          awaiter->result = VK_SUCCESS;
+        }
+        else if (error != VK_SUCCESS) {
+          awaiter->result = error;
+        }
+        else {
+          if (awaiter->deadline > now)
+            return false;
+
+          m_timeouts++;
+          awaiter->result = VK_TIMEOUT;
+        }
+
+        ready.push_back(awaiter);
+        return true;
+      });
+
+      // The awaiter lives in the coroutine frame, don't touch it once resumed.
+      for (auto* awaiter : ready)
+        awaiter->executor->post(awaiter->handle);
+
+      // A failed queue never completes anything, release what's waiting on it regardless.
+      std::erase_if(deferred, [&](Deferred& entry) {
+        if (entry.value > completed && error == VK_SUCCESS)
+          return false;
+
+        entry.callback();
+        return true;
+      });
+
+      if (!pending.empty() || !deferred.empty()) {
+        // Keep going without sleeping on the condition variable.
+        std::lock_guard lock(m_waitMutex);
+        m_waiters.insert(m_waiters.begin(), pending.begin(), pending.end());
+        m_deferred.insert(m_deferred.begin(), std::make_move_iterator(deferred.begin()), std::make_move_iterator(deferred.end()));
+        pending.clear();
+        deferred.clear();
+      }
+    }
+  }
+
+}
\ No newline at end of file
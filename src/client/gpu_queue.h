@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  class Executor;
+  class RenderContext;
+
+  struct GpuQueueStats {
+    uint64_t jobs;
+    uint64_t submits;
+    uint32_t largestBatch;
+    uint64_t timeouts;
+    bool     timelineSemaphores;
+  };
+
+  // Owns all submission to the device queue.
+  //
+  // Jobs hand over a recorded command buffer and get back a value on the
+  // queue's timeline. Everything queued while the previous vkQueueSubmit
+  // was in progress goes out together in the next one, so bursts of jobs
+  // pay the submit overhead once.
+  //
+  // With timeline semaphores each job signals its own value and completes
+  // independently. Without them each batch gets a fence, and its jobs complete
+  // together once that fence and every batch before it have signalled.
+  //
+  // Coroutines `co_await wait(value, executor)` rather than blocking. One
+  // thread waits on the GPU for everyone and resumes each waiter on its
+  // executor. waitUntil gives up at a deadline, so a shader that never
+  // finishes can't hold its job forever. Whatever that job's work still
+  // uses is handed over with whenComplete and released once it's done.
+  class GpuQueue : public NonCopyable {
+  public:
+    GpuQueue(RenderContext& context, VkQueue queue, bool timelineSemaphores);
+
+    ~GpuQueue();
+
+    // Queues a command buffer for the next batch, returns the value that marks its completion.
+    uint64_t submit(VkCommandBuffer commandBuffer);
+
+    bool isComplete(uint64_t value) const;
+
+    // Runs callback on the wait thread once value completes or the queue fails,
+    // or at shutdown once the queue is idle.
+    void whenComplete(uint64_t value, std::function<void()> callback);
+
+    // True once a submit or wait has failed, see m_error.
+    bool failed() const { return m_error != VK_SUCCESS; }
+
+    struct Awaiter {
+      GpuQueue*                             queue;
+      uint64_t                              value;
+      Executor*                             executor;
+      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+      std::coroutine_handle<>               handle   = nullptr;
+      VkResult                              result   = VK_NOT_READY;
+
+      bool await_ready();
+
+      void await_suspend(std::coroutine_handle<> awaiting);
+
+      // False if the deadline passed first, the work is then still in flight.
+      bool await_resume();
+    };
+
+    Awaiter wait(uint64_t value, Executor& executor) {
+      return Awaiter{ this, value, &executor };
+    }
+
+    Awaiter waitUntil(uint64_t value, Executor& executor, std::chrono::steady_clock::time_point deadline) {
+      return Awaiter{ this, value, &executor, deadline };
+    }
+
+    GpuQueueStats stats();
+
+  private:
+
+    struct Pending {
+      VkCommandBuffer commandBuffer;
+      uint64_t        value;
+    };
+
+    struct Deferred {
+      uint64_t              value;
+      std::function<void()> callback;
+    };
+
+    struct FenceBatch {
+      VkFence  fence;
+      uint64_t lastValue;
+    };
+
+    void submitLoop();
+
+    VkResult flush(const std::vector<Pending>& batch);
+
+    void setError(VkResult result);
+
+    void waitLoop();
+
+    // Blocks for up to timeoutNs waiting for value, then returns the latest completed value.
+    uint64_t waitForValue(uint64_t value, uint64_t timeoutNs);
+
+    RenderContext& m_context;
+    VkDevice       m_device;
+    VkQueue        m_queue;
+    VkSemaphore    m_timeline = VK_NULL_HANDLE;
+
+    // Sticky, once a submit or wait fails nothing after it can be trusted.
+    // Nothing more is submitted and every waiter fails with it.
+    std::atomic<VkResult> m_error = VK_SUCCESS;
+
+    std::mutex              m_submitMutex;
+    std::condition_variable m_submitCond;
+    std::vector<Pending>    m_queued;
+    uint64_t                m_nextValue = 1;
+    bool                    m_stopping  = false;
+
+    // Fence fallback only, added by the submit thread and retired by the wait thread.
+    std::mutex             m_batchMutex;
+    std::deque<FenceBatch> m_inFlight;
+    std::atomic<uint64_t>  m_completed = 0;
+
+    std::mutex              m_waitMutex;
+    std::condition_variable m_waitCond;
+    std::vector<Awaiter*>   m_waiters;
+    std::vector<Deferred>   m_deferred;
+    bool                    m_waitStopping = false;
+
+    std::atomic<uint64_t> m_jobs         = 0;
+    std::atomic<uint64_t> m_submits      = 0;
+    std::atomic<uint32_t> m_largestBatch = 0;
+    std::atomic<uint64_t> m_timeouts     = 0;
+
+    std::thread m_submitThread;
+    std::thread m_waitThread;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace shadey {
+
+  struct Hash128 {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool operator==(const Hash128& other) const = default;
+
+    std::string toString() const {
+      static constexpr char digits[] = "0123456789abcdef";
+
+      std::string str(32, '0');
+      for (int i = 0; i < 16; i++) {
+        str[15 - i] = digits[(hi >> (i * 4)) & 0xf];
+        str[31 - i] = digits[(lo >> (i * 4)) & 0xf];
+      }
+      return str;
+    }
+  };
+
+  struct Hash128Hasher {
+    size_t operator()(const Hash128& hash) const {
+      return size_t(hash.lo ^ (hash.hi * 0x9e3779b97f4a7c15ull));
+    }
+  };
+
+  // Two independently seeded FNV-1a lanes with a final avalanche.
+  // Stable across builds and platforms, so it is safe to use for on-disk keys.
+  class Hasher128 {
+  public:
+    Hasher128& update(const void* data, size_t size) {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+      for (size_t i = 0; i < size; i++) {
+        m_lo = (m_lo ^ bytes[i]) * Prime;
+        m_hi = (m_hi ^ bytes[i]) * Prime;
+      }
+
+      return *this;
+    }
+
+    Hasher128& update(std::string_view str) {
+      // Length prefix so adjacent strings can't alias.
+      const uint64_t length = str.length();
+      update(&length, sizeof(length));
+      return update(str.data(), str.length());
+    }
+
+    template <typename T>
+    Hasher128& updateValue(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      return update(&value, sizeof(value));
+    }
+
+    Hash128 finish() const {
+      return Hash128{ mix(m_lo), mix(m_hi ^ m_lo) };
+    }
+
+  private:
+
+    static constexpr uint64_t Prime = 0x100000001b3ull;
+
+    static uint64_t mix(uint64_t x) {
+      x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+      x ^= x >> 27; x *= 0x94d049bb133111ebull;
+      x ^= x >> 31;
+      return x;
+    }
+
+    uint64_t m_lo = 0xcbf29ce484222325ull;
+    uint64_t m_hi = 0x84222325cbf29ce4ull;
+  };
+
+}
\ No newline at end of file
@@ -1,15 +1,42 @@
 #include "hooks.h"
+#include "command_helpers.h"
+
+#include <stdexcept>
 
 namespace shadey {
 
   void ShadeyGlobalHookList::install(std::unique_ptr<ShadeyHook>&& ptr) {
-    m_hooks.push_back(std::move(ptr));
+    auto* command = dynamic_cast<ShadeyCommand*>(ptr.get());
+    if (!command) {
+      m_hooks.push_back(std::move(ptr));
+      return;
+    }
+
+    for (auto name : command->names()) {
+      if (!m_commands.emplace(name, command).second)
+        throw std::runtime_error("Command registered twice: " + std::string(name));
+    }
+
+    m_commandHooks.push_back(std::move(ptr));
   }
 
-  const std::vector<std::unique_ptr<ShadeyHook>>& ShadeyGlobalHookList::hooks() const {
-    return m_hooks;
+
+  void ShadeyGlobalHookList::dispatch(ShadeyClient& client, const SleepyDiscord::Message& message) {
+    const std::string_view name = parseCommandName(message.content);
+
+    if (!name.empty()) {
+      auto command = m_commands.find(name);
+      if (command != m_commands.end())
+        command->second->onCommand(ShadeyCommandContext(client, message));
+    }
+
+    for (auto& hook : m_hooks) {
+      if (hook->wantsMessage(message.content))
+        hook->onMessage(client, message);
+    }
   }
 
+
   ShadeyGlobalHookList* ShadeyGlobalHookList::instance() {
     static std::unique_ptr<ShadeyGlobalHookList> s_instance =
       std::make_unique<ShadeyGlobalHookList>();
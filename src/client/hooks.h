@@ -2,6 +2,7 @@
 
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "client.h"
@@ -10,22 +11,32 @@
 namespace shadey {
 
   class ShadeyHook;
+  class ShadeyCommand;
 
+  // Routes each message once: commands are looked up by name,
+  // everything else goes to the hooks whose prefilter accepts it.
   class ShadeyGlobalHookList : public NonCopyable {
   public:
     void install(std::unique_ptr<ShadeyHook>&& ptr);
 
     static ShadeyGlobalHookList* instance();
 
-    const std::vector<std::unique_ptr<ShadeyHook>>& hooks() const;
+    void dispatch(ShadeyClient& client, const SleepyDiscord::Message& message);
 
   private:
-    std::vector<std::unique_ptr<ShadeyHook>> m_hooks;
+    std::vector<std::unique_ptr<ShadeyHook>>             m_hooks;
+    std::vector<std::unique_ptr<ShadeyHook>>             m_commandHooks;
+    std::unordered_map<std::string_view, ShadeyCommand*> m_commands;
   };
 
   class ShadeyHook : public NonCopyable {
   public:
-    virtual void onMessage(ShadeyClient& client, SleepyDiscord::Message message) { }
+    virtual ~ShadeyHook() = default;
+
+    // Cheap check run before onMessage, so most messages never reach the hook.
+    virtual bool wantsMessage(std::string_view content) const { return true; }
+
+    virtual void onMessage(ShadeyClient& client, const SleepyDiscord::Message& message) { }
   };
 
   template <typename T>
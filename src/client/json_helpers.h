@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace shadey {
+
+  // Quotes and escapes a string for the JSON reports the tools print.
+  inline std::string jsonString(std::string_view str) {
+    std::string escaped = "\"";
+    for (char c : str) {
+      switch (c) {
+        case '"':  escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n";  break;
+        case '\r': escaped += "\\r";  break;
+        case '\t': escaped += "\\t";  break;
+        default:
+          if (uint8_t(c) < 0x20) {
+            char hex[8];
+            std::snprintf(hex, sizeof(hex), "\\u%04x", c);
+            escaped += hex;
+          }
+          else {
+            escaped += c;
+          }
+          break;
+      }
+    }
+    escaped += "\"";
+    return escaped;
+  }
+
+}
\ No newline at end of file
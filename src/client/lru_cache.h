@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace shadey {
+
+  // Least-recently-used map bounded by a total cost (usually bytes).
+  // Not thread safe, owners are expected to hold their own lock.
+  template <typename Key, typename Value, typename Hash = std::hash<Key>>
+  class LruCache {
+  public:
+    LruCache(size_t maxCost)
+      : m_maxCost(maxCost) { }
+
+    const Value* find(const Key& key) {
+      auto iter = m_map.find(key);
+      if (iter == m_map.end())
+        return nullptr;
+
+      // Move to the front, it's the most recently used now.
+      m_entries.splice(m_entries.begin(), m_entries, iter->second);
+      return &iter->second->value;
+    }
+
+    void insert(const Key& key, Value value, size_t cost) {
+      if (cost > m_maxCost)
+        return;
+
+      erase(key);
+
+      m_entries.push_front(Entry{ key, std::move(value), cost });
+      m_map.emplace(key, m_entries.begin());
+      m_cost += cost;
+
+      while (m_cost > m_maxCost)
+        evict();
+    }
+
+    void erase(const Key& key) {
+      auto iter = m_map.find(key);
+      if (iter == m_map.end())
+        return;
+
+      m_cost -= iter->second->cost;
+      m_entries.erase(iter->second);
+      m_map.erase(iter);
+    }
+
+    size_t size()    const { return m_entries.size(); }
+    size_t cost()    const { return m_cost; }
+    size_t maxCost() const { return m_maxCost; }
+    size_t evictions() const { return m_evictions; }
+
+  private:
+
+    struct Entry {
+      Key    key;
+      Value  value;
+      size_t cost;
+    };
+
+    void evict() {
+      const Entry& last = m_entries.back();
+      m_cost -= last.cost;
+      m_map.erase(last.key);
+      m_entries.pop_back();
+      m_evictions++;
+    }
+
+    using EntryList = std::list<Entry>;
+
+    EntryList                                                  m_entries;
+    std::unordered_map<Key, typename EntryList::iterator, Hash> m_map;
+
+    size_t m_cost      = 0;
+    size_t m_maxCost   = 0;
+    size_t m_evictions = 0;
+  };
+
+}
\ No newline at end of file
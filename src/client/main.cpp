@@ -1,10 +1,14 @@
 #include "client.h"
+#include "vulkan_registry.h"
 #include "token.h"
 
 int main(int argc, char** argv) {
   (void)argc;
   (void)argv;
 
+  // Parse vk.xml before connecting rather than on the first >vktype.
+  shadey::VulkanRegistry::instance();
+
   shadey::ShadeyClient client(g_AuthToken, 2);
   client.run();
 
@@ -0,0 +1,753 @@
+#include "png_encoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SHADEY_PNG_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "thread_pool.h"
+
+namespace shadey {
+
+  namespace {
+    static constexpr uint32_t g_bytesPerPixel = 4;
+
+    // Below this much raw data per strip, threading costs more than it saves.
+    static constexpr size_t g_minStripBytes = 256 * 1024;
+
+    // Past this many pixels, Auto trades ratio for speed.
+    static constexpr uint64_t g_autoFastPixels = 1024 * 1024;
+
+    struct CompressionParams {
+      uint32_t maxChain;
+      uint32_t niceLength;
+      bool     lazy;
+      uint8_t  zlibFlags;
+    };
+
+    static CompressionParams getCompressionParams(PngCompression compression, uint64_t pixels) {
+      if (compression == PngCompression::Auto)
+        compression = pixels > g_autoFastPixels ? PngCompression::Fast : PngCompression::Default;
+
+      switch (compression) {
+        case PngCompression::Fast: return { .maxChain = 4,   .niceLength = 32,  .lazy = false, .zlibFlags = 0x01 };
+        case PngCompression::Max:  return { .maxChain = 512, .niceLength = 258, .lazy = true,  .zlibFlags = 0xDA };
+        default:                   return { .maxChain = 32,  .niceLength = 128, .lazy = true,  .zlibFlags = 0x9C };
+      }
+    }
+
+    ////////////////////////////
+    // Checksums
+    ////////////////////////////
+
+    static const std::array<uint32_t, 256> g_crcTable = [] {
+      std::array<uint32_t, 256> table;
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+        table[i] = c;
+      }
+      return table;
+    }();
+
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+      crc = ~crc;
+      for (size_t i = 0; i < size; i++)
+        crc = g_crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+      return ~crc;
+    }
+
+    static constexpr uint32_t g_adlerBase = 65521;
+
+    static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+      uint32_t a = adler & 0xFFFF;
+      uint32_t b = adler >> 16;
+
+      while (size > 0) {
+        // Largest run that can't overflow before the modulo.
+        const size_t block = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < block; i++) {
+          a += data[i];
+          b += a;
+        }
+        a %= g_adlerBase;
+        b %= g_adlerBase;
+
+        data += block;
+        size -= block;
+      }
+
+      return (b << 16) | a;
+    }
+
+    // Checksum of A followed by B, given both checksums and the length of B.
+    static uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+      const uint32_t rem = uint32_t(length2 % g_adlerBase);
+
+      uint32_t sum1 = adler1 & 0xFFFF;
+      uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % g_adlerBase);
+
+      sum1 += (adler2 & 0xFFFF) + g_adlerBase - 1;
+      sum2 += (adler1 >> 16) + (adler2 >> 16) + g_adlerBase - rem;
+
+      if (sum1 >= g_adlerBase)        sum1 -= g_adlerBase;
+      if (sum1 >= g_adlerBase)        sum1 -= g_adlerBase;
+      if (sum2 >= g_adlerBase * 2)    sum2 -= g_adlerBase * 2;
+      if (sum2 >= g_adlerBase)        sum2 -= g_adlerBase;
+
+      return (sum2 << 16) | sum1;
+    }
+
+    ////////////////////////////
+    // Row filtering
+    ////////////////////////////
+
+    enum PngFilter : uint8_t {
+      PngFilter_None,
+      PngFilter_Sub,
+      PngFilter_Up,
+      PngFilter_Average,
+      PngFilter_Paeth,
+      PngFilter_Count,
+    };
+
+    static uint8_t paethPredictor(int a, int b, int c) {
+      const int p  = a + b - c;
+      const int pa = std::abs(p - a);
+      const int pb = std::abs(p - b);
+      const int pc = std::abs(p - c);
+
+      if (pa <= pb && pa <= pc) return uint8_t(a);
+      if (pb <= pc)             return uint8_t(b);
+      return uint8_t(c);
+    }
+
+    static uint8_t filterByte(PngFilter filter, uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
+      switch (filter) {
+        case PngFilter_Sub:     return uint8_t(x - a);
+        case PngFilter_Up:      return uint8_t(x - b);
+        case PngFilter_Average: return uint8_t(x - ((a + b) >> 1));
+        case PngFilter_Paeth:   return uint8_t(x - paethPredictor(a, b, c));
+        default:                return x;
+      }
+    }
+
+    // Treating filtered bytes as signed, smaller magnitudes compress better.
+    static uint32_t filterCost(uint8_t value) {
+      return value < 128 ? value : 256 - value;
+    }
+
+    static void scoreFiltersScalar(const uint8_t* cur, const uint8_t* prev, size_t begin, size_t end, uint64_t* scores) {
+      for (size_t i = begin; i < end; i++) {
+        const uint8_t a = i >= g_bytesPerPixel ? cur [i - g_bytesPerPixel] : 0;
+        const uint8_t c = i >= g_bytesPerPixel ? prev[i - g_bytesPerPixel] : 0;
+
+        for (uint32_t f = 0; f < PngFilter_Count; f++)
+          scores[f] += filterCost(filterByte(PngFilter(f), cur[i], a, prev[i], c));
+      }
+    }
+
+#ifdef SHADEY_PNG_SSE2
+    static __m128i absSigned8(__m128i v) {
+      return _mm_min_epu8(v, _mm_sub_epi8(_mm_setzero_si128(), v));
+    }
+
+    static __m128i abs16(__m128i v) {
+      return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+    }
+
+    static __m128i paethPredictor16(__m128i a, __m128i b, __m128i c) {
+      const __m128i pa = abs16(_mm_sub_epi16(b, c));
+      const __m128i pb = abs16(_mm_sub_epi16(a, c));
+      const __m128i pc = abs16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+
+      const __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+      const __m128i notB = _mm_cmpgt_epi16(pb, pc);
+
+      const __m128i pickA = _mm_andnot_si128(notA, _mm_set1_epi16(-1));
+      const __m128i pickB = _mm_andnot_si128(notB, notA);
+      const __m128i pickC = _mm_and_si128(notA, notB);
+
+      return _mm_or_si128(_mm_or_si128(
+        _mm_and_si128(pickA, a),
+        _mm_and_si128(pickB, b)),
+        _mm_and_si128(pickC, c));
+    }
+
+    static uint64_t horizontalSum(__m128i sad) {
+      return uint64_t(_mm_cvtsi128_si32(sad)) + uint64_t(_mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+    }
+#endif
+
+    static PngFilter chooseFilter(const uint8_t* cur, const uint8_t* prev, size_t rowBytes) {
+      uint64_t scores[PngFilter_Count] = { };
+
+      size_t i = std::min<size_t>(g_bytesPerPixel, rowBytes);
+      scoreFiltersScalar(cur, prev, 0, i, scores);
+
+#ifdef SHADEY_PNG_SSE2
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i one  = _mm_set1_epi8(1);
+
+      __m128i sums[PngFilter_Count] = { zero, zero, zero, zero, zero };
+
+      for (; i + 16 <= rowBytes; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur  + i));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur  + i - g_bytesPerPixel));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i - g_bytesPerPixel));
+
+        // floor((a + b) / 2), avg_epu8 rounds up.
+        const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+
+        const __m128i paeth = _mm_packus_epi16(
+          paethPredictor16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+          paethPredictor16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+
+        sums[PngFilter_None]    = _mm_add_epi64(sums[PngFilter_None],    _mm_sad_epu8(absSigned8(x), zero));
+        sums[PngFilter_Sub]     = _mm_add_epi64(sums[PngFilter_Sub],     _mm_sad_epu8(absSigned8(_mm_sub_epi8(x, a)), zero));
+        sums[PngFilter_Up]      = _mm_add_epi64(sums[PngFilter_Up],      _mm_sad_epu8(absSigned8(_mm_sub_epi8(x, b)), zero));
+        sums[PngFilter_Average] = _mm_add_epi64(sums[PngFilter_Average], _mm_sad_epu8(absSigned8(_mm_sub_epi8(x, average)), zero));
+        sums[PngFilter_Paeth]   = _mm_add_epi64(sums[PngFilter_Paeth],   _mm_sad_epu8(absSigned8(_mm_sub_epi8(x, paeth)), zero));
+      }
+
+      for (uint32_t f = 0; f < PngFilter_Count; f++)
+        scores[f] += horizontalSum(sums[f]);
+#endif
+
+      scoreFiltersScalar(cur, prev, i, rowBytes, scores);
+
+      return PngFilter(std::min_element(scores, scores + PngFilter_Count) - scores);
+    }
+
+    static void filterRow(PngFilter filter, const uint8_t* cur, const uint8_t* prev, uint8_t* out, size_t rowBytes) {
+      for (size_t i = 0; i < rowBytes; i++) {
+        const uint8_t a = i >= g_bytesPerPixel ? cur [i - g_bytesPerPixel] : 0;
+        const uint8_t c = i >= g_bytesPerPixel ? prev[i - g_bytesPerPixel] : 0;
+        out[i] = filterByte(filter, cur[i], a, prev[i], c);
+      }
+    }
+
+    ////////////////////////////
+    // Deflate
+    ////////////////////////////
+
+    class BitWriter {
+    public:
+      BitWriter(std::vector<uint8_t>& out)
+        : m_out(out) { }
+
+      void put(uint32_t value, uint32_t count) {
+        m_bits  |= uint64_t(value) << m_count;
+        m_count += count;
+
+        while (m_count >= 8) {
+          m_out.push_back(uint8_t(m_bits));
+          m_bits  >>= 8;
+          m_count -= 8;
+        }
+      }
+
+      void alignToByte() {
+        if (m_count)
+          put(0, 8 - m_count);
+      }
+
+    private:
+      std::vector<uint8_t>& m_out;
+      uint64_t              m_bits  = 0;
+      uint32_t              m_count = 0;
+    };
+
+    struct HuffmanCode {
+      uint16_t bits; // Already bit reversed for the LSB-first stream.
+      uint8_t  length;
+    };
+
+    static uint16_t reverseBits(uint32_t code, uint32_t length) {
+      uint32_t result = 0;
+      for (uint32_t i = 0; i < length; i++)
+        result |= ((code >> i) & 1) << (length - 1 - i);
+      return uint16_t(result);
+    }
+
+    static constexpr uint16_t g_lengthBase [29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static constexpr uint8_t  g_lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static constexpr uint16_t g_distBase   [30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static constexpr uint8_t  g_distExtra  [30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    static constexpr uint32_t g_windowSize = 32768;
+    static constexpr uint32_t g_minMatch   = 3;
+    static constexpr uint32_t g_maxMatch   = 258;
+    static constexpr uint32_t g_hashBits   = 15;
+
+    struct FixedHuffman {
+      HuffmanCode literals[288];
+      HuffmanCode distances[30];
+      uint8_t     lengthSymbol[g_maxMatch + 1];
+      uint8_t     distSymbol[g_windowSize + 1];
+
+      FixedHuffman() {
+        for (uint32_t i = 0; i < 288; i++) {
+          if      (i < 144) literals[i] = { reverseBits(0x30  + i,         8), 8 };
+          else if (i < 256) literals[i] = { reverseBits(0x190 + i - 144,   9), 9 };
+          else if (i < 280) literals[i] = { reverseBits(i - 256,           7), 7 };
+          else              literals[i] = { reverseBits(0xC0  + i - 280,   8), 8 };
+        }
+
+        for (uint32_t i = 0; i < 30; i++)
+          distances[i] = { reverseBits(i, 5), 5 };
+
+        for (uint32_t symbol = 0; symbol < 29; symbol++) {
+          const uint32_t end = symbol == 28 ? g_maxMatch + 1 : g_lengthBase[symbol + 1];
+          for (uint32_t length = g_lengthBase[symbol]; length < end; length++)
+            lengthSymbol[length] = uint8_t(symbol);
+        }
+        // 258 has its own code rather than 227 + 31.
+        lengthSymbol[g_maxMatch] = 28;
+
+        for (uint32_t symbol = 0; symbol < 30; symbol++) {
+          const uint32_t end = symbol == 29 ? g_windowSize + 1 : g_distBase[symbol + 1];
+          for (uint32_t dist = g_distBase[symbol]; dist < end; dist++)
+            distSymbol[dist] = uint8_t(symbol);
+        }
+      }
+    };
+
+    static const FixedHuffman& fixedHuffman() {
+      static const FixedHuffman s_tables;
+      return s_tables;
+    }
+
+    // Deflates one strip as a single fixed Huffman block.
+    // Non-final strips end in an empty stored block so the next strip starts byte aligned.
+    static void deflateStrip(const uint8_t* data, size_t size, bool final, const CompressionParams& params, std::vector<uint8_t>& out) {
+      const FixedHuffman& huffman = fixedHuffman();
+
+      BitWriter writer(out);
+      writer.put(final ? 1 : 0, 1);
+      writer.put(1, 2);
+
+      auto writeLiteral = [&](uint32_t symbol) {
+        writer.put(huffman.literals[symbol].bits, huffman.literals[symbol].length);
+      };
+
+      auto writeMatch = [&](uint32_t length, uint32_t dist) {
+        const uint32_t lengthSymbol = huffman.lengthSymbol[length];
+        writeLiteral(257 + lengthSymbol);
+        writer.put(length - g_lengthBase[lengthSymbol], g_lengthExtra[lengthSymbol]);
+
+        const uint32_t distSymbol = huffman.distSymbol[dist];
+        writer.put(huffman.distances[distSymbol].bits, huffman.distances[distSymbol].length);
+        writer.put(dist - g_distBase[distSymbol], g_distExtra[distSymbol]);
+      };
+
+      std::vector<int32_t> head(size_t(1) << g_hashBits, -1);
+      std::vector<int32_t> prev(size);
+
+      auto hashAt = [&](size_t i) {
+        const uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+        return (v * 2654435761u) >> (32 - g_hashBits);
+      };
+
+      auto insert = [&](size_t i) {
+        if (i + g_minMatch > size)
+          return;
+
+        const uint32_t hash = hashAt(i);
+        prev[i]    = head[hash];
+        head[hash] = int32_t(i);
+      };
+
+      auto findMatch = [&](size_t i, uint32_t& bestDist) -> uint32_t {
+        if (i + g_minMatch > size)
+          return 0;
+
+        const uint32_t maxLength = uint32_t(std::min<size_t>(g_maxMatch, size - i));
+
+        uint32_t best  = 0;
+        uint32_t chain = params.maxChain;
+
+        for (int32_t candidate = head[hashAt(i)];
+             candidate >= 0 && i - candidate <= g_windowSize && chain-- > 0;
+             candidate = prev[candidate]) {
+          // Cheap reject before the full compare.
+          if (data[candidate + best] != data[i + best])
+            continue;
+
+          uint32_t length = 0;
+          while (length < maxLength && data[candidate + length] == data[i + length])
+            length++;
+
+          if (length > best) {
+            best     = length;
+            bestDist = uint32_t(i - candidate);
+
+            if (best >= params.niceLength || best == maxLength)
+              break;
+          }
+        }
+
+        return best >= g_minMatch ? best : 0;
+      };
+
+      uint32_t pendingLength = 0;
+      uint32_t pendingDist   = 0;
+
+      size_t i = 0;
+      while (i < size) {
+        uint32_t dist   = 0;
+        uint32_t length = findMatch(i, dist);
+        insert(i);
+
+        if (!params.lazy) {
+          if (length) {
+            writeMatch(length, dist);
+            for (size_t k = i + 1; k < i + length; k++)
+              insert(k);
+            i += length;
+          }
+          else {
+            writeLiteral(data[i]);
+            i++;
+          }
+          continue;
+        }
+
+        // Lazy matching: a match found at i - 1 is only taken if i doesn't have a longer one.
+        if (pendingLength) {
+          if (length > pendingLength) {
+            writeLiteral(data[i - 1]);
+            pendingLength = length;
+            pendingDist   = dist;
+            i++;
+          }
+          else {
+            writeMatch(pendingLength, pendingDist);
+            const size_t end = i - 1 + pendingLength;
+            for (size_t k = i + 1; k < end; k++)
+              insert(k);
+            pendingLength = 0;
+            i = end;
+          }
+          continue;
+        }
+
+        if (length) {
+          pendingLength = length;
+          pendingDist   = dist;
+        }
+        else {
+          writeLiteral(data[i]);
+        }
+        i++;
+      }
+
+      if (pendingLength)
+        writeMatch(pendingLength, pendingDist);
+
+      writeLiteral(256);
+
+      if (final) {
+        writer.alignToByte();
+      }
+      else {
+        writer.put(0, 3);
+        writer.alignToByte();
+        out.insert(out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+      }
+    }
+
+    ////////////////////////////
+    // PNG container
+    ////////////////////////////
+
+    static void writeU32(std::vector<uint8_t>& out, uint32_t value) {
+      out.push_back(uint8_t(value >> 24));
+      out.push_back(uint8_t(value >> 16));
+      out.push_back(uint8_t(value >> 8));
+      out.push_back(uint8_t(value));
+    }
+
+    static void beginChunk(std::vector<uint8_t>& out, const char* type) {
+      // Length gets patched in by endChunk.
+      writeU32(out, 0);
+      out.insert(out.end(), type, type + 4);
+    }
+
+    static void endChunk(std::vector<uint8_t>& out, size_t chunkStart) {
+      const size_t   dataStart = chunkStart + 8;
+      const uint32_t length    = uint32_t(out.size() - dataStart);
+
+      out[chunkStart + 0] = uint8_t(length >> 24);
+      out[chunkStart + 1] = uint8_t(length >> 16);
+      out[chunkStart + 2] = uint8_t(length >> 8);
+      out[chunkStart + 3] = uint8_t(length);
+
+      writeU32(out, crc32(0, out.data() + chunkStart + 4, length + 4));
+    }
+
+    struct EncodedStrip {
+      std::vector<uint8_t> chunk;
+      uint32_t             adler;
+      size_t               rawSize;
+    };
+
+    struct EncodedImage {
+      std::vector<EncodedStrip> strips;
+      size_t                    size = 0;
+    };
+
+    // Filters and deflates the rows in parallel strips, each one already wrapped in its own chunk.
+    // fdAT chunks start with a sequence number, strip i gets firstSequence + i.
+    // The rows can be one band of a larger image: prevRow is the row above the first one, if any,
+    // and only the first band starts the zlib stream and only the last one ends it.
+    static EncodedImage encodeStrips(const uint8_t* bytes, uint32_t width, uint32_t height, uint32_t stride, const CompressionParams& params, const char* chunkType, uint32_t firstSequence,
+                                     const uint8_t* prevRow = nullptr, bool firstBand = true, bool lastBand = true) {
+      const size_t rowBytes  = size_t(width) * g_bytesPerPixel;
+      const bool   sequenced = std::memcmp(chunkType, "fdAT", 4) == 0;
+
+      ThreadPool* pool = ThreadPool::instance();
+
+      // Aim for a few strips per thread so uneven strips even out,
+      // but never so small that the per-strip overhead dominates.
+      const uint32_t minRows       = uint32_t(std::max<size_t>(1, g_minStripBytes / rowBytes));
+      const uint32_t targetStrips  = pool->threadCount() * 4;
+      const uint32_t rowsPerStrip  = std::max(minRows, (height + targetStrips - 1) / targetStrips);
+      const uint32_t stripCount    = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+      EncodedImage image;
+      image.strips.resize(stripCount);
+
+      pool->parallelFor(stripCount, [&](size_t index) {
+        const uint32_t firstRow = uint32_t(index) * rowsPerStrip;
+        const uint32_t rowCount = std::min(rowsPerStrip, height - firstRow);
+
+        std::vector<uint8_t> filtered(size_t(rowCount) * (rowBytes + 1));
+        const std::vector<uint8_t> zeroRow(rowBytes);
+
+        for (uint32_t y = 0; y < rowCount; y++) {
+          const uint32_t row  = firstRow + y;
+          const uint8_t* cur  = bytes + size_t(row) * stride;
+          const uint8_t* prev = row ? cur - stride : (prevRow ? prevRow : zeroRow.data());
+
+          uint8_t* out = filtered.data() + size_t(y) * (rowBytes + 1);
+
+          const PngFilter filter = chooseFilter(cur, prev, rowBytes);
+          out[0] = filter;
+          filterRow(filter, cur, prev, out + 1, rowBytes);
+        }
+
+        EncodedStrip& strip = image.strips[index];
+        strip.adler   = adler32(1, filtered.data(), filtered.size());
+        strip.rawSize = filtered.size();
+
+        strip.chunk.reserve(filtered.size() / 2 + 64);
+        beginChunk(strip.chunk, chunkType);
+
+        if (sequenced)
+          writeU32(strip.chunk, firstSequence + uint32_t(index));
+
+        // The zlib header rides along with the first strip.
+        if (firstBand && index == 0)
+          strip.chunk.insert(strip.chunk.end(), { 0x78, params.zlibFlags });
+
+        deflateStrip(filtered.data(), filtered.size(), lastBand && index + 1 == stripCount, params, strip.chunk);
+        endChunk(strip.chunk, 0);
+      });
+
+      for (const auto& strip : image.strips)
+        image.size += strip.chunk.size();
+
+      return image;
+    }
+
+    // Appends the strips, returns the checksum of everything so far given the one before them.
+    static uint32_t appendStrips(std::vector<uint8_t>& png, const EncodedImage& image, uint32_t adler) {
+      for (const auto& strip : image.strips) {
+        png.insert(png.end(), strip.chunk.begin(), strip.chunk.end());
+        adler = adler32Combine(adler, strip.adler, strip.rawSize);
+      }
+
+      return adler;
+    }
+
+    // The zlib trailer can only be known once every strip is done,
+    // it goes in its own tiny chunk which is perfectly legal.
+    static void appendTrailer(std::vector<uint8_t>& png, uint32_t adler, const char* chunkType, uint32_t sequence) {
+      const size_t start = png.size();
+      beginChunk(png, chunkType);
+      if (std::memcmp(chunkType, "fdAT", 4) == 0)
+        writeU32(png, sequence);
+      writeU32(png, adler);
+      endChunk(png, start);
+    }
+
+    // Appends the strips followed by the zlib trailer, returns the sequence number after the trailer's.
+    static uint32_t appendImage(std::vector<uint8_t>& png, const EncodedImage& image, const char* chunkType, uint32_t firstSequence) {
+      const uint32_t adler           = appendStrips(png, image, 1);
+      const uint32_t trailerSequence = firstSequence + uint32_t(image.strips.size());
+
+      appendTrailer(png, adler, chunkType, trailerSequence);
+      return trailerSequence + 1;
+    }
+
+    static constexpr uint8_t g_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    static void appendHeader(std::vector<uint8_t>& png, uint32_t width, uint32_t height) {
+      png.insert(png.end(), g_signature, g_signature + sizeof(g_signature));
+
+      const size_t start = png.size();
+      beginChunk(png, "IHDR");
+      writeU32(png, width);
+      writeU32(png, height);
+      png.insert(png.end(), {
+        8,   // Bit depth
+        6,   // RGBA
+        0,   // Deflate
+        0,   // Adaptive filtering
+        0 }); // No interlace
+      endChunk(png, start);
+    }
+
+    static void appendEnd(std::vector<uint8_t>& png) {
+      const size_t start = png.size();
+      beginChunk(png, "IEND");
+      endChunk(png, start);
+    }
+  }
+
+  std::vector<uint8_t> encodePng(const void* pixels, uint32_t width, uint32_t height, uint32_t stride, PngCompression compression) {
+    if (width == 0 || height == 0)
+      throw std::runtime_error("Can't encode an empty image");
+
+    const CompressionParams params = getCompressionParams(compression, uint64_t(width) * height);
+    const EncodedImage      image  = encodeStrips(reinterpret_cast<const uint8_t*>(pixels), width, height, stride, params, "IDAT", 0);
+
+    std::vector<uint8_t> png;
+    png.reserve(image.size + 64);
+
+    appendHeader(png, width, height);
+    appendImage(png, image, "IDAT", 0);
+    appendEnd(png);
+
+    return png;
+  }
+
+
+  PngStreamEncoder::PngStreamEncoder(uint32_t width, uint32_t height, PngCompression compression)
+    : m_width      (width)
+    , m_height     (height)
+    , m_compression(compression) {
+    if (width == 0 || height == 0)
+      throw std::runtime_error("Can't encode an empty image");
+
+    appendHeader(m_png, width, height);
+  }
+
+
+  void PngStreamEncoder::addRows(const void* pixels, uint32_t rowCount, uint32_t stride) {
+    if (rowCount == 0 || m_rowsAdded + rowCount > m_height)
+      throw std::runtime_error("Wrong number of rows for this image");
+
+    const uint8_t* bytes    = reinterpret_cast<const uint8_t*>(pixels);
+    const bool     first    = m_rowsAdded == 0;
+    const bool     last     = m_rowsAdded + rowCount == m_height;
+    const size_t   rowBytes = size_t(m_width) * g_bytesPerPixel;
+
+    const CompressionParams params = getCompressionParams(m_compression, uint64_t(m_width) * m_height);
+    const EncodedImage      image  = encodeStrips(bytes, m_width, rowCount, stride, params, "IDAT", 0, first ? nullptr : m_lastRow.data(), first, last);
+
+    m_png.reserve(m_png.size() + image.size + 64);
+    m_adler = appendStrips(m_png, image, m_adler);
+
+    // The next band filters against our last row, by then the caller may have reused the pixels.
+    const uint8_t* lastRow = bytes + size_t(rowCount - 1) * stride;
+    m_lastRow.assign(lastRow, lastRow + rowBytes);
+
+    m_rowsAdded += rowCount;
+  }
+
+
+  std::vector<uint8_t> PngStreamEncoder::finish() {
+    if (m_rowsAdded != m_height)
+      throw std::runtime_error("Image is missing rows");
+
+    appendTrailer(m_png, m_adler, "IDAT", 0);
+    appendEnd(m_png);
+    return std::move(m_png);
+  }
+
+
+  ApngEncoder::ApngEncoder(uint32_t width, uint32_t height, uint32_t frameCount, uint32_t fps, PngCompression compression)
+    : m_width      (width)
+    , m_height     (height)
+    , m_frameCount (frameCount)
+    , m_fps        (fps)
+    , m_compression(compression) {
+    if (width == 0 || height == 0 || frameCount == 0 || fps == 0)
+      throw std::runtime_error("Can't encode an empty animation");
+
+    appendHeader(m_png, width, height);
+
+    const size_t start = m_png.size();
+    beginChunk(m_png, "acTL");
+    writeU32(m_png, frameCount);
+    writeU32(m_png, 0); // Loop forever
+    endChunk(m_png, start);
+  }
+
+
+  void ApngEncoder::addFrame(const void* pixels, uint32_t stride) {
+    if (m_framesAdded == m_frameCount)
+      throw std::runtime_error("Too many frames for this animation");
+
+    {
+      const size_t start = m_png.size();
+      beginChunk(m_png, "fcTL");
+      writeU32(m_png, m_sequence++);
+      writeU32(m_png, m_width);
+      writeU32(m_png, m_height);
+      writeU32(m_png, 0); // X offset
+      writeU32(m_png, 0); // Y offset
+      m_png.insert(m_png.end(), {
+        0, 1,                                      // Delay numerator
+        uint8_t(m_fps >> 8), uint8_t(m_fps),       // Delay denominator
+        0,                                         // Leave the frame as is
+        0 });                                      // Replace rather than blend
+      endChunk(m_png, start);
+    }
+
+    // The first frame doubles as the still image for decoders without APNG support.
+    const char* chunkType = m_framesAdded == 0 ? "IDAT" : "fdAT";
+
+    const CompressionParams params = getCompressionParams(m_compression, uint64_t(m_width) * m_height);
+    const EncodedImage      image  = encodeStrips(reinterpret_cast<const uint8_t*>(pixels), m_width, m_height, stride, params, chunkType, m_sequence);
+
+    m_png.reserve(m_png.size() + image.size + 64);
+    const uint32_t next = appendImage(m_png, image, chunkType, m_sequence);
+
+    // Only fdAT chunks take up sequence numbers.
+    if (m_framesAdded != 0)
+      m_sequence = next;
+
+    m_framesAdded++;
+  }
+
+
+  std::vector<uint8_t> ApngEncoder::finish() {
+    if (m_framesAdded != m_frameCount)
+      throw std::runtime_error("Animation is missing frames");
+
+    appendEnd(m_png);
+    return std::move(m_png);
+  }
+
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  enum class PngCompression {
+    Auto,
+    Fast,
+    Default,
+    Max,
+  };
+
+  // Encodes RGBA8 pixels to a PNG in memory.
+  // Rows are split into strips that are filtered and deflated in parallel.
+  std::vector<uint8_t> encodePng(const void* pixels, uint32_t width, uint32_t height, uint32_t stride, PngCompression compression = PngCompression::Auto);
+
+  // Builds a PNG from bands of rows handed over top to bottom, so a large image
+  // can be encoded as it's read back without ever being in memory all at once.
+  // Only the last row of each band is kept, its pixels can be reused once addRows returns.
+  class PngStreamEncoder : public NonCopyable {
+  public:
+    PngStreamEncoder(uint32_t width, uint32_t height, PngCompression compression = PngCompression::Auto);
+
+    void addRows(const void* pixels, uint32_t rowCount, uint32_t stride);
+
+    // Only valid once all height rows have been added.
+    std::vector<uint8_t> finish();
+
+  private:
+
+    uint32_t             m_width;
+    uint32_t             m_height;
+    PngCompression       m_compression;
+    uint32_t             m_rowsAdded = 0;
+    uint32_t             m_adler     = 1;
+    std::vector<uint8_t> m_lastRow;
+    std::vector<uint8_t> m_png;
+  };
+
+  // Builds an animated PNG a frame at a time, so each frame can be encoded
+  // as soon as it's read back while later ones are still rendering.
+  // Every frame is shown for 1/fps seconds and the animation loops forever.
+  class ApngEncoder : public NonCopyable {
+  public:
+    ApngEncoder(uint32_t width, uint32_t height, uint32_t frameCount, uint32_t fps, PngCompression compression = PngCompression::Auto);
+
+    void addFrame(const void* pixels, uint32_t stride);
+
+    // Only valid once all frameCount frames have been added.
+    std::vector<uint8_t> finish();
+
+  private:
+
+    uint32_t             m_width;
+    uint32_t             m_height;
+    uint32_t             m_frameCount;
+    uint32_t             m_fps;
+    PngCompression       m_compression;
+    uint32_t             m_framesAdded = 0;
+    // Shared by fcTL and fdAT chunks, in file order.
+    uint32_t             m_sequence    = 0;
+    std::vector<uint8_t> m_png;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,584 @@
+#include "render_context.h"
+
+#include <exception>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <iostream>
+
+#include "shader_helpers.h"
+
+namespace shadey {
+
+  namespace {
+    // One per device, suffixed with its index.
+    static constexpr std::string_view g_pipelineCachePrefix   = "pipeline_cache_";
+    static constexpr uint32_t         g_pipelineSaveThreshold = 8;
+    static constexpr auto             g_pipelineSaveInterval  = std::chrono::minutes(5);
+
+    static constexpr VkDeviceSize     g_maxIdleTargetBytes    = 256 * 1024 * 1024;
+  }
+
+  std::string g_vertexShaders[RendererVertexType_Count] = {
+R"(
+#version 450
+
+void main() {
+  vec2 coord = vec2(
+    float(gl_VertexIndex & 2),
+    float(gl_VertexIndex & 1) * 2.0f);
+
+  gl_Position = vec4(-1.0f + 2.0f * coord, 0.0f, 1.0f);
+}
+)",
+
+R"(
+#version 450
+
+vec2 positions[3] = vec2[](
+    vec2(-0.5, 0.5),
+    vec2(0.5, 0.5),
+    vec2(0.0, -0.5)
+);
+
+void main() {
+  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+}
+)"
+};
+
+  RenderContext::RenderContext(VkInstance instance, VkPhysicalDevice physDevice, uint32_t index)
+    : m_instance  (instance)
+    , m_physDevice(physDevice)
+    , m_index     (index)
+    , m_created   (std::chrono::steady_clock::now()) {
+    vkGetPhysicalDeviceProperties(m_physDevice, &m_properties);
+    vkGetPhysicalDeviceMemoryProperties(m_physDevice, &m_memProperties);
+
+    // The biggest device local heap, system memory for software devices.
+    for (uint32_t i = 0; i < m_memProperties.memoryHeapCount; i++) {
+      if (m_memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        m_deviceMemory = std::max(m_deviceMemory, m_memProperties.memoryHeaps[i].size);
+    }
+
+    // Pick our queue family
+    {
+      uint32_t queueFamilyCount = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(m_physDevice, &queueFamilyCount, nullptr);
+
+      std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+      vkGetPhysicalDeviceQueueFamilyProperties(m_physDevice, &queueFamilyCount, queueFamilies.data());
+
+      for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+        // Compute shaders dispatch on the same queue.
+        const VkQueueFlags required = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+        if ((queueFamilies[i].queueFlags & required) == required) {
+          m_graphicsFamily     = i;
+          m_timestampValidBits = queueFamilies[i].timestampValidBits;
+          break;
+        }
+      }
+
+      if (m_graphicsFamily == UINT32_MAX)
+        throw std::runtime_error("No graphics queue available");
+    }
+
+    // Create our logical device
+    {
+      const float queuePriority = 1.0f;
+
+      VkDeviceQueueCreateInfo queueInfo = {
+        .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = m_graphicsFamily,
+        .queueCount       = 1,
+        .pQueuePriorities = &queuePriority
+      };
+
+      VkPhysicalDeviceFeatures supportedFeatures = { };
+      vkGetPhysicalDeviceFeatures(m_physDevice, &supportedFeatures);
+
+      // Only needed for >bench, everything else works without it.
+      m_pipelineStatistics = supportedFeatures.pipelineStatisticsQuery;
+
+      VkPhysicalDeviceFeatures deviceFeatures = {
+        .pipelineStatisticsQuery = m_pipelineStatistics
+      };
+
+      // Timeline semaphores let batched jobs complete independently, fences are the fallback.
+      VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES
+      };
+
+      if (m_properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features2 = {
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+          .pNext = &timelineFeatures
+        };
+
+        vkGetPhysicalDeviceFeatures2(m_physDevice, &features2);
+      }
+
+      m_timelineSemaphores = timelineFeatures.timelineSemaphore;
+
+      VkDeviceCreateInfo deviceInfo = {
+        .sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext                = m_timelineSemaphores ? &timelineFeatures : nullptr,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos    = &queueInfo,
+        .pEnabledFeatures     = &deviceFeatures
+      };
+
+      if (vkCreateDevice(m_physDevice, &deviceInfo, nullptr, &m_device) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create Vulkan device");
+
+      vkGetDeviceQueue(m_device, m_graphicsFamily, 0, &m_queue);
+    }
+
+    // Create the pipeline layout every job shares
+    {
+      VkPushConstantRange pushConstantRange = {
+        .stageFlags = RendererPushConstants::Stages,
+        .offset     = 0,
+        .size       = sizeof(RendererPushConstants)
+      };
+
+      VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange
+      };
+
+      if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_layout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    // And the one every compute job shares
+    {
+      VkDescriptorSetLayoutBinding binding = {
+        .binding         = 0,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .descriptorCount = 1,
+        .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT
+      };
+
+      VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings    = &binding
+      };
+
+      if (vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, nullptr, &m_storageImageLayout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create descriptor set layout");
+
+      VkPushConstantRange pushConstantRange = {
+        .stageFlags = RendererPushConstants::ComputeStages,
+        .offset     = 0,
+        .size       = sizeof(RendererPushConstants)
+      };
+
+      VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &m_storageImageLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange
+      };
+
+      if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_computeLayout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create compute pipeline layout");
+    }
+
+    // Create vertex shaders, these never change
+    for (uint32_t i = 0; i < RendererVertexType_Count; i++) {
+      auto spv = compileShader(false, ShaderStage_Vertex, g_vertexShaders[i]);
+
+      VkShaderModuleCreateInfo moduleInfo = {
+        .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = spv.size(),
+        .pCode    = reinterpret_cast<const uint32_t*>(spv.data())
+      };
+
+      if (vkCreateShaderModule(m_device, &moduleInfo, nullptr, &m_vertexModules[i]) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create vertex shader module");
+    }
+
+    loadPipelineCache();
+
+    m_targetPool  = std::make_unique<RenderTargetPool>(*this, VK_FORMAT_R8G8B8A8_UNORM, g_maxIdleTargetBytes);
+    m_gpuQueue    = std::make_unique<GpuQueue>(*this, m_queue, m_timelineSemaphores);
+  }
+
+
+  RenderContext::~RenderContext() {
+    // Drains anything still queued before the device goes idle.
+    m_gpuQueue = nullptr;
+
+    if (m_device != VK_NULL_HANDLE)
+      vkDeviceWaitIdle(m_device);
+
+    m_targetPool = nullptr;
+
+    for (auto fence : m_freeFences)
+      vkDestroyFence(m_device, fence, nullptr);
+
+    if (m_pipelineCache != VK_NULL_HANDLE) {
+      savePipelineCache();
+      vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+    }
+
+    for (auto& [key, renderPass] : m_renderPasses)
+      vkDestroyRenderPass(m_device, renderPass, nullptr);
+
+    for (auto module : m_vertexModules) {
+      if (module != VK_NULL_HANDLE)
+        vkDestroyShaderModule(m_device, module, nullptr);
+    }
+
+    if (m_layout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(m_device, m_layout, nullptr);
+
+    if (m_computeLayout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(m_device, m_computeLayout, nullptr);
+
+    if (m_storageImageLayout != VK_NULL_HANDLE)
+      vkDestroyDescriptorSetLayout(m_device, m_storageImageLayout, nullptr);
+
+    for (auto pool : m_allPools)
+      vkDestroyCommandPool(m_device, pool, nullptr);
+
+    if (m_device != VK_NULL_HANDLE)
+      vkDestroyDevice(m_device, nullptr);
+  }
+
+
+  const char* RenderContext::deviceTypeName() const {
+    switch (m_properties.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return "discrete";
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return "virtual";
+      case VK_PHYSICAL_DEVICE_TYPE_CPU:            return "software";
+      default:                                     return "other";
+    }
+  }
+
+
+  VkDeviceSize RenderContext::freeMemory() {
+    // Render targets are nearly all we allocate, good enough without VK_EXT_memory_budget.
+    const VkDeviceSize used = m_targetPool->stats().liveBytes;
+    return used < m_deviceMemory ? m_deviceMemory - used : 0;
+  }
+
+
+  bool RenderContext::lost() const {
+    return m_gpuQueue->failed();
+  }
+
+
+  void RenderContext::jobStarted() {
+    std::lock_guard lock(m_loadMutex);
+
+    if (m_activeJobs++ == 0)
+      m_busySince = std::chrono::steady_clock::now();
+
+    m_jobs++;
+  }
+
+
+  void RenderContext::jobFinished() {
+    std::lock_guard lock(m_loadMutex);
+
+    if (--m_activeJobs == 0)
+      m_busyTime += std::chrono::steady_clock::now() - m_busySince;
+  }
+
+
+  RenderContextLoad RenderContext::load() {
+    std::lock_guard lock(m_loadMutex);
+
+    const auto now  = std::chrono::steady_clock::now();
+    const auto busy = m_busyTime + (m_activeJobs ? now - m_busySince : std::chrono::steady_clock::duration::zero());
+    const auto up   = now - m_created;
+
+    return RenderContextLoad {
+      .activeJobs  = m_activeJobs,
+      .jobs        = m_jobs,
+      .utilization = up.count() ? double(busy.count()) / double(up.count()) : 0.0
+    };
+  }
+
+
+  VkRenderPass RenderContext::renderPass(VkFormat format, bool loadContents) {
+    std::lock_guard lock(m_renderPassMutex);
+
+    const uint64_t key = (uint64_t(format) << 1) | (loadContents ? 1 : 0);
+
+    auto iter = m_renderPasses.find(key);
+    if (iter != m_renderPasses.end())
+      return iter->second;
+
+    VkAttachmentDescription colorAttachment = {
+      .format         = format,
+      .samples        = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp         = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout  = loadContents ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    };
+
+    VkAttachmentReference reference = {
+      .attachment = 0,
+      .layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+
+    VkSubpassDescription subpass = {
+      .pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS,
+      .colorAttachmentCount = 1,
+      .pColorAttachments    = &reference
+    };
+
+    VkRenderPassCreateInfo renderPassInfo = {
+      .sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments    = &colorAttachment,
+      .subpassCount    = 1,
+      .pSubpasses      = &subpass
+    };
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create render pass");
+
+    m_renderPasses.emplace(key, renderPass);
+    return renderPass;
+  }
+
+
+  VkPipeline RenderContext::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineInfo, bool useCache) {
+    // Pipeline caches are internally synchronized, no lock needed to use one.
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(m_device, useCache ? m_pipelineCache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create graphics pipeline");
+
+    if (useCache)
+      pipelineCreated();
+    return pipeline;
+  }
+
+
+  VkPipeline RenderContext::createComputePipeline(const VkComputePipelineCreateInfo& pipelineInfo, bool useCache) {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateComputePipelines(m_device, useCache ? m_pipelineCache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create compute pipeline");
+
+    if (useCache)
+      pipelineCreated();
+    return pipeline;
+  }
+
+
+  void RenderContext::pipelineCreated() {
+    bool save = false;
+    {
+      std::lock_guard lock(m_pipelineCacheMutex);
+      m_pipelinesSinceSave++;
+
+      save = m_pipelinesSinceSave >= g_pipelineSaveThreshold ||
+             std::chrono::steady_clock::now() - m_lastSave >= g_pipelineSaveInterval;
+    }
+
+    if (save)
+      savePipelineCache();
+  }
+
+
+  std::filesystem::path RenderContext::pipelineCachePath() const {
+    return std::string(g_pipelineCachePrefix) + std::to_string(m_index) + ".bin";
+  }
+
+
+  void RenderContext::loadPipelineCache() {
+    std::vector<char> data;
+    {
+      std::ifstream file(pipelineCachePath(), std::ios::binary | std::ios::ate);
+      if (file) {
+        data.resize(size_t(file.tellg()));
+        file.seekg(0);
+
+        if (!file.read(data.data(), data.size()))
+          data.clear();
+      }
+    }
+
+    // Drivers are meant to reject foreign blobs themselves, but don't trust that.
+    struct Header {
+      uint32_t length;
+      uint32_t version;
+      uint32_t vendorID;
+      uint32_t deviceID;
+      uint8_t  uuid[VK_UUID_SIZE];
+    };
+
+    if (data.size() >= sizeof(Header)) {
+      Header header;
+      std::memcpy(&header, data.data(), sizeof(header));
+
+      if (header.version  != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+          header.vendorID != m_properties.vendorID ||
+          header.deviceID != m_properties.deviceID ||
+          std::memcmp(header.uuid, m_properties.pipelineCacheUUID, VK_UUID_SIZE))
+        data.clear();
+    }
+    else {
+      data.clear();
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {
+      .sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = data.size(),
+      .pInitialData    = data.empty() ? nullptr : data.data()
+    };
+
+    if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache) != VK_SUCCESS) {
+      // Try again from scratch in case the driver didn't like our data.
+      cacheInfo.initialDataSize = 0;
+      cacheInfo.pInitialData    = nullptr;
+
+      if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+
+    m_lastSave = std::chrono::steady_clock::now();
+  }
+
+
+  void RenderContext::savePipelineCache() {
+    std::lock_guard lock(m_pipelineCacheMutex);
+
+    m_pipelinesSinceSave = 0;
+    m_lastSave           = std::chrono::steady_clock::now();
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device, m_pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+      return;
+
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_device, m_pipelineCache, &size, data.data()) != VK_SUCCESS)
+      return;
+
+    // Write next to it and rename over, a crash mid-save shouldn't lose the old cache.
+    const std::filesystem::path path     = pipelineCachePath();
+    const std::filesystem::path tempPath = path.string() + ".tmp";
+    {
+      std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+      if (!file.write(data.data(), size)) {
+        std::cout << "Failed to write pipeline cache" << std::endl;
+        return;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+      std::cout << "Failed to save pipeline cache: " << ec.message() << std::endl;
+  }
+
+
+  uint32_t RenderContext::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const {
+    uint32_t fallback = UINT32_MAX;
+
+    for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+      if (!(typeBits & (1u << i)))
+        continue;
+
+      const VkMemoryPropertyFlags flags = m_memProperties.memoryTypes[i].propertyFlags;
+      if ((flags & required) != required)
+        continue;
+
+      if ((flags & preferred) == preferred)
+        return i;
+
+      if (fallback == UINT32_MAX)
+        fallback = i;
+    }
+
+    if (fallback == UINT32_MAX)
+      throw std::runtime_error("No suitable memory type available");
+
+    return fallback;
+  }
+
+
+  VkFence RenderContext::acquireFence() {
+    {
+      std::lock_guard lock(m_fenceMutex);
+
+      if (!m_freeFences.empty()) {
+        VkFence fence = m_freeFences.back();
+        m_freeFences.pop_back();
+        return fence;
+      }
+    }
+
+    VkFenceCreateInfo fenceInfo = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+
+    VkFence fence = VK_NULL_HANDLE;
+    if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create fence");
+
+    return fence;
+  }
+
+
+  void RenderContext::releaseFence(VkFence fence) {
+    // Only ever handed back once it's no longer in flight.
+    vkResetFences(m_device, 1, &fence);
+
+    std::lock_guard lock(m_fenceMutex);
+    m_freeFences.push_back(fence);
+  }
+
+
+  VkCommandPool RenderContext::acquireCommandPool() {
+    {
+      std::lock_guard lock(m_poolMutex);
+
+      if (!m_freePools.empty()) {
+        VkCommandPool pool = m_freePools.back();
+        m_freePools.pop_back();
+        return pool;
+      }
+    }
+
+    VkCommandPoolCreateInfo commandPoolInfo = {
+      .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = m_graphicsFamily
+    };
+
+    VkCommandPool pool = VK_NULL_HANDLE;
+    if (vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &pool) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create command pool");
+
+    std::lock_guard lock(m_poolMutex);
+    m_allPools.push_back(pool);
+    return pool;
+  }
+
+
+  void RenderContext::releaseCommandPool(VkCommandPool pool) {
+    // Callers free their command buffers first, this just recycles the memory.
+    vkResetCommandPool(m_device, pool, 0);
+
+    std::lock_guard lock(m_poolMutex);
+    m_freePools.push_back(pool);
+  }
+
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gpu_queue.h"
+#include "non_copyable.h"
+#include "renderer.h"
+#include "render_target_pool.h"
+
+namespace shadey {
+
+  struct RenderContextLoad {
+    uint32_t activeJobs;
+    uint64_t jobs;
+    // Fraction of the context's lifetime spent with at least one job running.
+    double   utilization;
+  };
+
+  // Vulkan state for one device, shared by every render job on it.
+  // The DeviceScheduler opens one per usable device at startup and keeps
+  // them alive until shutdown, so jobs only pay for their own objects.
+  class RenderContext : public NonCopyable {
+
+  public:
+
+    // The instance belongs to the caller and has to outlive the context.
+    // index is the device's position in the instance's enumeration.
+    RenderContext(VkInstance instance, VkPhysicalDevice physDevice, uint32_t index);
+
+    ~RenderContext();
+
+    VkInstance vkInstance() const { return m_instance; }
+
+    VkPhysicalDevice physicalDevice() const { return m_physDevice; }
+
+    VkDevice device() const { return m_device; }
+
+    uint32_t index() const { return m_index; }
+
+    const char* deviceName() const { return m_properties.deviceName; }
+
+    VkPhysicalDeviceType deviceType() const { return m_properties.deviceType; }
+
+    const char* deviceTypeName() const;
+
+    // lavapipe, llvmpipe, SwiftShader and friends.
+    bool software() const { return m_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU; }
+
+    // Size of the largest device local heap.
+    VkDeviceSize deviceMemory() const { return m_deviceMemory; }
+
+    // deviceMemory less what our render targets hold, ignoring everyone else on the device.
+    VkDeviceSize freeMemory();
+
+    // Set once a submit fails, usually with VK_ERROR_DEVICE_LOST. Nothing on it can be trusted after.
+    bool lost() const;
+
+    // Called by each Renderer for its lifetime, feeding load().
+    void jobStarted();
+
+    void jobFinished();
+
+    RenderContextLoad load();
+
+    uint32_t graphicsFamily() const { return m_graphicsFamily; }
+
+    VkPipelineLayout pipelineLayout() const { return m_layout; }
+
+    // Compute shaders write their output through a storage image at set 0, binding 0.
+    VkPipelineLayout computePipelineLayout() const { return m_computeLayout; }
+
+    VkDescriptorSetLayout storageImageLayout() const { return m_storageImageLayout; }
+
+    uint32_t maxComputeInvocations() const { return m_properties.limits.maxComputeWorkGroupInvocations; }
+
+    const uint32_t* maxComputeWorkGroupSize() const { return m_properties.limits.maxComputeWorkGroupSize; }
+
+    VkShaderModule vertexModule(RendererVertexType type) const { return m_vertexModules[type]; }
+
+    // With loadContents the pass keeps what's already in the target instead of clearing it,
+    // expecting it in COLOR_ATTACHMENT_OPTIMAL. Both variants are compatible with the same pipelines.
+    VkRenderPass renderPass(VkFormat format, bool loadContents = false);
+
+    // Without useCache the driver compiles from scratch and the pipeline cache never sees it.
+    VkPipeline createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineInfo, bool useCache = true);
+
+    VkPipeline createComputePipeline(const VkComputePipelineCreateInfo& pipelineInfo, bool useCache = true);
+
+    void savePipelineCache();
+
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+
+    RenderTargetPool& targetPool() { return *m_targetPool; }
+
+    GpuQueue& gpuQueue() { return *m_gpuQueue; }
+
+    bool timelineSemaphores() const { return m_timelineSemaphores; }
+
+    bool pipelineStatistics() const { return m_pipelineStatistics; }
+
+    // Nanoseconds per timestamp tick, 0 if the graphics queue can't write timestamps.
+    float timestampPeriod() const { return m_timestampValidBits ? m_properties.limits.timestampPeriod : 0.0f; }
+
+    uint32_t timestampValidBits() const { return m_timestampValidBits; }
+
+    VkFence acquireFence();
+
+    void releaseFence(VkFence fence);
+
+    VkCommandPool acquireCommandPool();
+
+    void releaseCommandPool(VkCommandPool pool);
+
+  private:
+
+    std::filesystem::path pipelineCachePath() const;
+
+    void loadPipelineCache();
+
+    // Counts towards the next save of the pipeline cache, saving if it's due.
+    void pipelineCreated();
+
+    VkInstance       m_instance       = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physDevice     = VK_NULL_HANDLE;
+    uint32_t         m_index          = 0;
+    uint32_t         m_graphicsFamily = UINT32_MAX;
+    VkDevice         m_device         = VK_NULL_HANDLE;
+    VkQueue          m_queue          = VK_NULL_HANDLE;
+    bool             m_timelineSemaphores = false;
+    bool             m_pipelineStatistics = false;
+    uint32_t         m_timestampValidBits = 0;
+
+    VkPhysicalDeviceProperties       m_properties    = { };
+    VkPhysicalDeviceMemoryProperties m_memProperties = { };
+    VkDeviceSize                     m_deviceMemory  = 0;
+
+    VkPipelineLayout      m_layout                                   = VK_NULL_HANDLE;
+    VkPipelineLayout      m_computeLayout                            = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_storageImageLayout                       = VK_NULL_HANDLE;
+    VkShaderModule        m_vertexModules[RendererVertexType_Count] = { };
+
+    std::mutex                                 m_renderPassMutex;
+    std::unordered_map<uint64_t, VkRenderPass> m_renderPasses;
+
+    std::mutex                            m_pipelineCacheMutex;
+    VkPipelineCache                       m_pipelineCache     = VK_NULL_HANDLE;
+    uint32_t                              m_pipelinesSinceSave = 0;
+    std::chrono::steady_clock::time_point m_lastSave;
+
+    std::unique_ptr<RenderTargetPool> m_targetPool;
+    std::unique_ptr<GpuQueue>         m_gpuQueue;
+
+    std::mutex                 m_fenceMutex;
+    std::vector<VkFence>       m_freeFences;
+
+    std::mutex                               m_loadMutex;
+    uint32_t                                 m_activeJobs = 0;
+    uint64_t                                 m_jobs       = 0;
+    std::chrono::steady_clock::time_point    m_created;
+    std::chrono::steady_clock::time_point    m_busySince;
+    std::chrono::steady_clock::duration      m_busyTime   = { };
+
+    std::mutex                 m_poolMutex;
+    std::vector<VkCommandPool> m_freePools;
+    std::vector<VkCommandPool> m_allPools;
+  };
+
+}
\ No newline at end of file
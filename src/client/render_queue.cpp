@@ -0,0 +1,155 @@
+#include "render_queue.h"
+#include "executor.h"
+
+#include <iostream>
+#include <memory>
+
+namespace shadey {
+
+  // Jobs spend most of their time suspended on the GPU, so allow a few more
+  // in flight than there are executor threads to keep every stage busy.
+  static constexpr size_t g_maxRunningJobs   = 8;
+  static constexpr size_t g_queueCapacity    = 32;
+  static constexpr size_t g_jobsPerUserLimit = 3;
+
+  RenderQueue::RenderQueue(size_t maxRunning, size_t capacity, size_t perUserLimit)
+    : m_maxRunning(maxRunning)
+    , m_capacity(capacity)
+    , m_perUserLimit(perUserLimit) {
+  }
+
+
+  RenderQueue* RenderQueue::instance() {
+    static std::unique_ptr<RenderQueue> s_instance = std::make_unique<RenderQueue>(
+      g_maxRunningJobs,
+      g_queueCapacity,
+      g_jobsPerUserLimit);
+
+    return s_instance.get();
+  }
+
+
+  bool RenderQueue::enqueue(const std::string& channel, const std::string& user, std::function<Task<>()> job) {
+    {
+      std::lock_guard lock(m_mutex);
+
+      size_t& userJobs = m_userJobs[user];
+      if (m_queued >= m_capacity || userJobs >= m_perUserLimit) {
+        if (userJobs == 0)
+          m_userJobs.erase(user);
+
+        m_rejected++;
+        return false;
+      }
+
+      auto [queueIter, newChannel] = m_queues.try_emplace(channel);
+      if (newChannel)
+        m_channels.push_back(channel);
+
+      ChannelQueue& queue = queueIter->second;
+
+      auto [jobsIter, newUser] = queue.jobs.try_emplace(user);
+      if (newUser)
+        queue.users.push_back(user);
+
+      jobsIter->second.push_back(std::move(job));
+
+      userJobs++;
+      m_queued++;
+    }
+
+    startJobs();
+    return true;
+  }
+
+
+  RenderQueueStats RenderQueue::stats() {
+    std::lock_guard lock(m_mutex);
+
+    return RenderQueueStats {
+      .queued       = m_queued,
+      .running      = m_running,
+      .completed    = m_completed,
+      .rejected     = m_rejected,
+      .capacity     = m_capacity,
+      .perUserLimit = m_perUserLimit,
+      .maxRunning   = m_maxRunning,
+    };
+  }
+
+
+  void RenderQueue::startJobs() {
+    for (;;) {
+      std::string             user;
+      std::function<Task<>()> job;
+      {
+        std::lock_guard lock(m_mutex);
+        if (m_running >= m_maxRunning || m_channels.empty())
+          return;
+
+        job = popNext(user);
+        m_running++;
+      }
+
+      spawn(runJob(std::move(user), std::move(job)));
+    }
+  }
+
+
+  Task<> RenderQueue::runJob(std::string user, std::function<Task<>()> job) {
+    // Get off whichever thread queued us before doing anything.
+    co_await Executor::instance()->schedule();
+
+    try {
+      co_await job();
+    }
+    catch (const std::exception& e) {
+      std::cout << "Render job failed: " << e.what() << std::endl;
+    }
+    catch (...) {
+      // Whatever it was, the slot and the user's quota still have to come back.
+      std::cout << "Render job failed with an unknown exception" << std::endl;
+    }
+
+    {
+      std::lock_guard lock(m_mutex);
+      m_running--;
+      m_completed++;
+
+      if (--m_userJobs[user] == 0)
+        m_userJobs.erase(user);
+    }
+
+    startJobs();
+  }
+
+
+  std::function<Task<>()> RenderQueue::popNext(std::string& user) {
+    const std::string channel = std::move(m_channels.front());
+    m_channels.pop_front();
+
+    ChannelQueue& queue = m_queues[channel];
+
+    user = std::move(queue.users.front());
+    queue.users.pop_front();
+
+    auto& jobs = queue.jobs[user];
+    std::function<Task<>()> job = std::move(jobs.front());
+    jobs.pop_front();
+
+    // Anyone with more to do goes to the back of the line.
+    if (jobs.empty())
+      queue.jobs.erase(user);
+    else
+      queue.users.push_back(user);
+
+    if (queue.users.empty())
+      m_queues.erase(channel);
+    else
+      m_channels.push_back(channel);
+
+    m_queued--;
+    return job;
+  }
+
+}
\ No newline at end of file
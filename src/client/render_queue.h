@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "non_copyable.h"
+#include "task.h"
+
+namespace shadey {
+
+  struct RenderQueueStats {
+    size_t   queued;
+    size_t   running;
+    uint64_t completed;
+    uint64_t rejected;
+    size_t   capacity;
+    size_t   perUserLimit;
+    size_t   maxRunning;
+  };
+
+  // Bounded queue of render jobs. Jobs are coroutines run on the render
+  // Executor, so the gateway thread never blocks on compilation, the GPU or
+  // encoding, and a job waiting on the GPU doesn't hold up anyone else's stages.
+  //
+  // Jobs are picked round robin across channels, then across users within a
+  // channel, so one busy user or channel can't starve everyone else.
+  class RenderQueue : public NonCopyable {
+  public:
+    RenderQueue(size_t maxRunning, size_t capacity, size_t perUserLimit);
+
+    static RenderQueue* instance();
+
+    // Returns false without queueing if the queue, or this user's share of it, is full.
+    bool enqueue(const std::string& channel, const std::string& user, std::function<Task<>()> job);
+
+    RenderQueueStats stats();
+
+  private:
+
+    // Starts queued jobs while there are free slots.
+    void startJobs();
+
+    Task<> runJob(std::string user, std::function<Task<>()> job);
+
+    // Must hold m_mutex and have at least one queued job.
+    std::function<Task<>()> popNext(std::string& user);
+
+    struct ChannelQueue {
+      // Users with queued jobs in this channel, next up at the front.
+      std::deque<std::string>                                              users;
+      std::unordered_map<std::string, std::deque<std::function<Task<>()>>> jobs;
+    };
+
+    size_t m_maxRunning;
+    size_t m_capacity;
+    size_t m_perUserLimit;
+
+    std::mutex m_mutex;
+
+    // Channels with queued jobs, next up at the front.
+    std::deque<std::string>                       m_channels;
+    std::unordered_map<std::string, ChannelQueue> m_queues;
+
+    // Queued + running jobs per user.
+    std::unordered_map<std::string, size_t>       m_userJobs;
+
+    size_t   m_queued    = 0;
+    size_t   m_running   = 0;
+    uint64_t m_completed = 0;
+    uint64_t m_rejected  = 0;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "render_context.h"
+
+namespace shadey {
+
+  namespace {
+    static uint32_t formatSize(VkFormat format) {
+      switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM: return 4;
+        default: throw std::runtime_error("Unsupported render target format");
+      }
+    }
+  }
+
+  RenderTargetPool::RenderTargetPool(RenderContext& context, VkFormat format, VkDeviceSize maxIdleBytes)
+    : m_context     (context)
+    , m_device      (context.device())
+    , m_format      (format)
+    , m_maxIdleBytes(maxIdleBytes) { }
+
+
+  RenderTargetPool::~RenderTargetPool() {
+    for (auto target : m_idle)
+      destroy(target);
+  }
+
+
+  RenderTarget* RenderTargetPool::acquire(uint32_t width, uint32_t height, uint32_t flags) {
+    {
+      std::lock_guard lock(m_mutex);
+
+      auto iter = m_buckets.find(bucket(width, height, flags));
+      if (iter != m_buckets.end() && !iter->second.empty()) {
+        auto entry = iter->second.back();
+        iter->second.pop_back();
+
+        RenderTarget* target = *entry;
+        m_idle.erase(entry);
+        m_idleBytes -= target->memorySize;
+
+        m_hits++;
+        return target;
+      }
+
+      m_misses++;
+    }
+
+    RenderTarget* target = create(width, height, flags);
+
+    std::lock_guard lock(m_mutex);
+    m_live++;
+    m_liveBytes += target->memorySize;
+    return target;
+  }
+
+
+  void RenderTargetPool::release(RenderTarget* target) {
+    std::lock_guard lock(m_mutex);
+
+    m_idle.push_front(target);
+    m_buckets[bucket(target->width, target->height, target->flags)].push_back(m_idle.begin());
+    m_idleBytes += target->memorySize;
+
+    evictIdle();
+  }
+
+
+  RenderTargetPoolStats RenderTargetPool::stats() {
+    std::lock_guard lock(m_mutex);
+
+    return RenderTargetPoolStats {
+      .hits         = m_hits,
+      .misses       = m_misses,
+      .evictions    = m_evictions,
+      .idleTargets  = m_idle.size(),
+      .liveTargets  = m_live,
+      .idleBytes    = size_t(m_idleBytes),
+      .liveBytes    = size_t(m_liveBytes),
+      .maxIdleBytes = size_t(m_maxIdleBytes)
+    };
+  }
+
+
+  void RenderTargetPool::evictIdle() {
+    while (m_idleBytes > m_maxIdleBytes && !m_idle.empty()) {
+      RenderTarget* target = m_idle.back();
+
+      auto& entries = m_buckets[bucket(target->width, target->height, target->flags)];
+      entries.erase(std::find(entries.begin(), entries.end(), std::prev(m_idle.end())));
+
+      m_idle.pop_back();
+      m_idleBytes -= target->memorySize;
+      m_liveBytes -= target->memorySize;
+      m_live--;
+      m_evictions++;
+
+      destroy(target);
+    }
+  }
+
+
+  RenderTarget* RenderTargetPool::create(uint32_t width, uint32_t height, uint32_t flags) {
+    RenderTarget* target = new RenderTarget();
+    target->width  = width;
+    target->height = height;
+    target->flags  = flags;
+
+    // Clean up whatever we made if anything below throws.
+    struct Guard {
+      RenderTargetPool* pool;
+      RenderTarget*     target;
+      ~Guard() { if (target) pool->destroy(target); }
+    } guard = { this, target };
+
+    if (flags & (RenderTargetFlag_Image | RenderTargetFlag_Storage)) {
+      const VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+        ((flags & RenderTargetFlag_Image)   ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0) |
+        ((flags & RenderTargetFlag_Storage) ? VK_IMAGE_USAGE_STORAGE_BIT          : 0);
+
+      VkImageCreateInfo imageInfo = {
+        .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType     = VK_IMAGE_TYPE_2D,
+        .format        = m_format,
+        .extent        = { width, height, 1 },
+        .mipLevels     = 1,
+        .arrayLayers   = 1,
+        .samples       = VK_SAMPLE_COUNT_1_BIT,
+        .tiling        = VK_IMAGE_TILING_OPTIMAL,
+        .usage         = usage,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+      };
+
+      if (vkCreateImage(m_device, &imageInfo, nullptr, &target->image) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create image");
+
+      {
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, target->image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize  = memRequirements.size;
+        allocInfo.memoryTypeIndex = m_context.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &target->imageMemory) != VK_SUCCESS)
+          throw std::runtime_error("Failed to allocate image memory");
+
+        if (vkBindImageMemory(m_device, target->image, target->imageMemory, 0) != VK_SUCCESS)
+          throw std::runtime_error("Failed to bind image memory");
+
+        target->memorySize += memRequirements.size;
+      }
+
+      VkImageViewCreateInfo imageViewInfo = {
+        .sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image    = target->image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format   = m_format,
+        .subresourceRange = {
+          .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+          .baseMipLevel   = 0,
+          .levelCount     = 1,
+          .baseArrayLayer = 0,
+          .layerCount     = 1
+        }
+      };
+
+      if (vkCreateImageView(m_device, &imageViewInfo, nullptr, &target->imageView) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create image view");
+    }
+
+    if (flags & RenderTargetFlag_Image) {
+      VkFramebufferCreateInfo framebufferInfo = {
+        .sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass      = m_context.renderPass(m_format),
+        .attachmentCount = 1,
+        .pAttachments    = &target->imageView,
+        .width           = width,
+        .height          = height,
+        .layers          = 1
+      };
+
+      if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &target->framebuffer) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create framebuffer");
+    }
+
+    if (flags & RenderTargetFlag_Readback) {
+      // Tightly packed rows of the target format, nothing more.
+      target->bufferSize = VkDeviceSize(formatSize(m_format)) * width * height;
+
+      VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size  = target->bufferSize,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT
+      };
+
+      if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &target->buffer) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create buffer");
+
+      {
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, target->buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize  = memRequirements.size;
+        allocInfo.memoryTypeIndex = m_context.findMemoryType(memRequirements.memoryTypeBits,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &target->bufferMemory) != VK_SUCCESS)
+          throw std::runtime_error("Failed to allocate buffer memory");
+
+        target->memorySize += memRequirements.size;
+      }
+
+      if (vkBindBufferMemory(m_device, target->buffer, target->bufferMemory, 0) != VK_SUCCESS)
+        throw std::runtime_error("Failed to bind buffer memory");
+
+      // Stays mapped for the lifetime of the target.
+      if (vkMapMemory(m_device, target->bufferMemory, 0, VK_WHOLE_SIZE, 0, &target->bufferMemPtr) != VK_SUCCESS)
+        throw std::runtime_error("Failed to map buffer memory");
+    }
+
+    guard.target = nullptr;
+    return target;
+  }
+
+
+  void RenderTargetPool::destroy(RenderTarget* target) {
+    if (target->framebuffer != VK_NULL_HANDLE)
+      vkDestroyFramebuffer(m_device, target->framebuffer, nullptr);
+
+    if (target->buffer != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, target->buffer, nullptr);
+
+    if (target->bufferMemory != VK_NULL_HANDLE)
+      vkFreeMemory(m_device, target->bufferMemory, nullptr);
+
+    if (target->imageView != VK_NULL_HANDLE)
+      vkDestroyImageView(m_device, target->imageView, nullptr);
+
+    if (target->image != VK_NULL_HANDLE)
+      vkDestroyImage(m_device, target->image, nullptr);
+
+    if (target->imageMemory != VK_NULL_HANDLE)
+      vkFreeMemory(m_device, target->imageMemory, nullptr);
+
+    delete target;
+  }
+
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  class RenderContext;
+
+  // What a target is made of. Large renders leave out the readback buffer
+  // and copy their rows out through small readback-only targets instead.
+  // Storage images are written by compute shaders and have no framebuffer.
+  enum RenderTargetFlags : uint32_t {
+    RenderTargetFlag_Image    = 1u << 0,
+    RenderTargetFlag_Readback = 1u << 1,
+    RenderTargetFlag_Storage  = 1u << 2,
+    RenderTargetFlag_All      = RenderTargetFlag_Image | RenderTargetFlag_Readback,
+  };
+
+  // A colour target plus the host-visible buffer it gets read back into.
+  struct RenderTarget {
+    uint32_t       width        = 0;
+    uint32_t       height       = 0;
+    uint32_t       flags        = 0;
+    VkImage        image        = VK_NULL_HANDLE;
+    VkDeviceMemory imageMemory  = VK_NULL_HANDLE;
+    VkImageView    imageView    = VK_NULL_HANDLE;
+    VkFramebuffer  framebuffer  = VK_NULL_HANDLE;
+    VkBuffer       buffer       = VK_NULL_HANDLE;
+    VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
+    void*          bufferMemPtr = nullptr;
+    VkDeviceSize   bufferSize   = 0;
+    VkDeviceSize   memorySize   = 0;
+  };
+
+  struct RenderTargetPoolStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t   idleTargets;
+    size_t   liveTargets;
+    size_t   idleBytes;
+    size_t   liveBytes;
+    size_t   maxIdleBytes;
+  };
+
+  // Recycles render targets bucketed by resolution.
+  // Idle targets are kept around up to a memory cap, least recently used go first.
+  class RenderTargetPool : public NonCopyable {
+  public:
+    RenderTargetPool(RenderContext& context, VkFormat format, VkDeviceSize maxIdleBytes);
+
+    ~RenderTargetPool();
+
+    RenderTarget* acquire(uint32_t width, uint32_t height, uint32_t flags = RenderTargetFlag_All);
+
+    void release(RenderTarget* target);
+
+    VkFormat format() const { return m_format; }
+
+    RenderTargetPoolStats stats();
+
+  private:
+
+    RenderTarget* create(uint32_t width, uint32_t height, uint32_t flags);
+
+    void destroy(RenderTarget* target);
+
+    void evictIdle();
+
+    // Widths are nowhere near 29 bits, the flags go in the top three.
+    static uint64_t bucket(uint32_t width, uint32_t height, uint32_t flags) {
+      return (uint64_t(flags) << 61) | (uint64_t(width) << 32) | height;
+    }
+
+    RenderContext& m_context;
+    VkDevice       m_device;
+    VkFormat       m_format;
+    VkDeviceSize   m_maxIdleBytes;
+
+    std::mutex m_mutex;
+
+    // Most recently released at the front.
+    std::list<RenderTarget*>                                                  m_idle;
+    std::unordered_map<uint64_t, std::vector<std::list<RenderTarget*>::iterator>> m_buckets;
+
+    VkDeviceSize m_idleBytes = 0;
+    VkDeviceSize m_liveBytes = 0;
+    size_t       m_live      = 0;
+
+    uint64_t m_hits      = 0;
+    uint64_t m_misses    = 0;
+    uint64_t m_evictions = 0;
+  };
+
+}
\ No newline at end of file
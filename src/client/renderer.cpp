@@ -4,98 +4,144 @@
 #include <stdexcept>
 #include <vector>
 #include <array>
+#include <chrono>
+#include <span>
 #include <sstream>
-#include <atomic>
 
 #include "string_helpers.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
 #include "shader_helpers.h"
+#include "png_encoder.h"
+#include "render_context.h"
+#include "executor.h"
+#include "gpu_queue.h"
 
 namespace shadey {
 
-  std::string g_vertexShaders[RendererVertexType_Count] = {
-R"(
-#version 450
+  static constexpr VkFormat g_renderFormat = VK_FORMAT_R8G8B8A8_UNORM;
 
-void main() {
-  vec2 coord = vec2(
-    float(gl_VertexIndex & 2),
-    float(gl_VertexIndex & 1) * 2.0f);
+  // Targets animations cycle through. Three keeps the GPU a frame or two
+  // ahead of the encoder without holding many targets per job.
+  static constexpr uint32_t g_frameRingSize = 3;
 
-  gl_Position = vec4(-1.0f + 2.0f * coord, 0.0f, 1.0f);
-}
-)",
+  static constexpr uint32_t g_maxFrames = 240;
+  static constexpr uint32_t g_maxFps    = 60;
 
-R"(
-#version 450
+  // Bounds the total work of one animation, e.g. 240 frames at 512x512 or 16 at 2048x2048.
+  static constexpr uint64_t g_maxAnimationPixels = 64ull * 1024 * 1024;
 
-vec2 positions[3] = vec2[](
-    vec2(-0.5, 0.5),
-    vec2(0.5, 0.5),
-    vec2(0.0, -0.5)
-);
+  // Renders bigger than this are drawn as tiles, a batch at a time, so a slow
+  // shader can be stopped part way and still show what it got through.
+  static constexpr uint64_t g_tiledPixels = 1024 * 1024;
+  static constexpr uint32_t g_tileSize    = 256;
 
-void main() {
-  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-}
-)"
-};
+  // Staging buffers for tiled renders, each holds one row of tiles on its way to the encoder.
+  static constexpr uint32_t g_bandRingSize = 3;
 
-  Renderer::Renderer() {
-  }
+  // Batches are sized from the last one's time to take about this long.
+  static constexpr double   g_tileBatchMs      = 50.0;
+  static constexpr uint32_t g_maxTilesPerBatch = 64;
 
+  // GPU time a tiled render gets before the remaining tiles are skipped.
+  static constexpr auto g_gpuBudget  = std::chrono::seconds(10);
+  // Past this a job stops waiting on the GPU altogether. Its work can't be
+  // taken back once submitted, so it's abandoned rather than cancelled.
+  static constexpr auto g_gpuTimeout = std::chrono::seconds(15);
 
-  Renderer::~Renderer() {
-    if (m_device != VK_NULL_HANDLE)
-      vkDeviceWaitIdle(m_device);
+  // Every device manages at least 128, most a good deal more, checked against the device before use.
+  static constexpr uint32_t g_maxLocalInvocations = 1024;
 
-    if (m_commandBuffer != VK_NULL_HANDLE)
-      vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_commandBuffer);
+  // Saves every GLSL compute shader declaring its own local size from the localSize directive,
+  // HLSL ones give [numthreads] themselves. Either way dispatches are sized from what got compiled.
+  static std::string fixComputeCode(std::string code, const uint32_t localSize[2]) {
+    // The version fixCode falls back to predates compute shaders.
+    if (code.starts_with("#version 330\n"))
+      code.replace(0, 12, "#version 450");
 
-    if (m_commandPool != VK_NULL_HANDLE)
-      vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    if (code.find("local_size") != std::string::npos)
+      return code;
 
-    if (m_framebuffer != VK_NULL_HANDLE)
-      vkDestroyFramebuffer(m_device, m_framebuffer, nullptr);
+    const std::string layout = "layout(local_size_x = " + std::to_string(localSize[0]) + ", local_size_y = " + std::to_string(localSize[1]) + ") in;\n";
 
-    if (m_pipeline != VK_NULL_HANDLE)
-      vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    // Has to come after #version, which fixCode made sure there is.
+    const size_t version = code.find("#version");
+    const size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+    if (lineEnd == std::string::npos)
+      return code + "\n" + layout;
 
-    if (m_renderpass != VK_NULL_HANDLE)
-      vkDestroyRenderPass(m_device, m_renderpass, nullptr);
+    return code.substr(0, lineEnd + 1) + layout + code.substr(lineEnd + 1);
+  }
 
-    if (m_layout != VK_NULL_HANDLE)
-      vkDestroyPipelineLayout(m_device, m_layout, nullptr);
+  Renderer::Renderer(RenderContext& context)
+    : m_context(context)
+    , m_device (context.device()) {
+    m_context.jobStarted();
+  }
 
-    if (m_fragModule != VK_NULL_HANDLE)
-      vkDestroyShaderModule(m_device, m_fragModule, nullptr);
 
-    if (m_vertModule != VK_NULL_HANDLE)
-      vkDestroyShaderModule(m_device, m_vertModule, nullptr);
+  Renderer::~Renderer() {
+    // Captured by value, a job that timed out is long gone by the time its work finishes.
+    auto release = [
+      context        = &m_context,
+      device         = m_device,
+      target         = m_target,
+      bands          = std::move(m_bands),
+      frameSlots     = std::move(m_frameSlots),
+      descriptorPool = m_descriptorPool,
+      commandPool    = m_commandPool,
+      commandBuffer  = m_commandBuffer,
+      pipeline       = m_pipeline,
+      modules        = std::array{ m_vertModule, m_fragModule, m_compModule },
+      queryPools     = std::array{ m_timestampPool, m_statisticsPool }
+    ] {
+      if (target != nullptr)
+        context->targetPool().release(target);
+
+      for (auto band : bands)
+        context->targetPool().release(band);
+
+      // Frees every set along with it.
+      if (descriptorPool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+
+      for (const auto& slot : frameSlots) {
+        if (slot.target != nullptr && slot.target != target)
+          context->targetPool().release(slot.target);
+
+        if (slot.commandBuffer != VK_NULL_HANDLE)
+          vkFreeCommandBuffers(device, commandPool, 1, &slot.commandBuffer);
+      }
 
-    if (m_buffer != VK_NULL_HANDLE)
-      vkDestroyBuffer(m_device, m_buffer, nullptr);
+      if (commandBuffer != VK_NULL_HANDLE)
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 
-    if (m_bufferMemory != VK_NULL_HANDLE)
-      vkFreeMemory(m_device, m_bufferMemory, nullptr);
+      if (commandPool != VK_NULL_HANDLE)
+        context->releaseCommandPool(commandPool);
 
-    if (m_imageView != VK_NULL_HANDLE)
-      vkDestroyImageView(m_device, m_imageView, nullptr);
+      if (pipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, pipeline, nullptr);
 
-    if (m_image != VK_NULL_HANDLE)
-      vkDestroyImage(m_device, m_image, nullptr);
+      for (auto module : modules) {
+        if (module != VK_NULL_HANDLE)
+          vkDestroyShaderModule(device, module, nullptr);
+      }
 
-    if (m_imageMemory != VK_NULL_HANDLE)
-      vkFreeMemory(m_device, m_imageMemory, nullptr);
+      for (auto pool : queryPools) {
+        if (pool != VK_NULL_HANDLE)
+          vkDestroyQueryPool(device, pool, nullptr);
+      }
+
+      context->jobFinished();
+    };
 
-    if (m_device != VK_NULL_HANDLE)
-      vkDestroyDevice(m_device, nullptr);
+    // Timeouts leave work on the GPU. Everything it uses is released once that completes,
+    // and until then the job keeps its slot so the scheduler doesn't count the device as idle.
+    if (m_submission && !m_context.gpuQueue().isComplete(m_submission)) {
+      m_context.gpuQueue().whenComplete(m_submission, std::move(release));
+      return;
+    }
 
-    if (m_instance != VK_NULL_HANDLE)
-      vkDestroyInstance(m_instance, nullptr);
+    release();
   }
 
 
@@ -113,11 +159,36 @@ void main() {
   }
 
 
+  void Renderer::fixCode(ShaderProgram& program) {
+    fixCode(program.hlsl, program.fragment);
+
+    if (!program.vertex.empty())
+      fixCode(program.hlsl, program.vertex);
+  }
+
+
+  void Renderer::checkResolution(uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0)
+      throw std::runtime_error("Can't have a resolution with an extent that is 0");
+
+    if (width > 16384 || height > 16384)
+      throw std::runtime_error("Can't have a resolution with an extent greater than 16384");
+
+    if (width * height > 4096 * 2048)
+      throw std::runtime_error("Can't have a resolution with an area greater than 4096 * 2048");
+  }
+
+
   RendererOptions Renderer::getRendererOptions(const std::string& code) {
     RendererOptions options = {
       .clearColor = { 0.0f, 0.0f, 0.0f, 1.0f },
       .vertexType = RendererVertexType_Quad,
-      .resolution = { 512, 512 }
+      .resolution = { 512, 512 },
+      .compression = PngCompression::Auto,
+      .frames = 1,
+      .fps = 30,
+      .compute = false,
+      .localSize = { 8, 8 }
     };
 
     std::istringstream iss(code);
@@ -153,6 +224,14 @@ void main() {
         if (param == "type") {
           if (value.starts_with("tri"))
             options.vertexType = RendererVertexType_Triangle;
+          else if (value == "compute")
+            options.compute = true;
+        }
+
+        if (param == "localSize") {
+          sscanf(value.c_str(), "%u %u",
+            &options.localSize[0],
+            &options.localSize[1]);
         }
 
         if (param == "resolution") {
@@ -160,493 +239,892 @@ void main() {
             &options.resolution[0],
             &options.resolution[1]);
 
-          if (options.resolution[0] == 0 || options.resolution[1] == 0)
-            throw std::runtime_error("Can't have a resolution with an extent that is 0");
-
-          if (options.resolution[0] > 16384 || options.resolution[1] > 16384)
-            throw std::runtime_error("Can't have a resolution with an extent greater than 16384");
+          checkResolution(options.resolution[0], options.resolution[1]);
+        }
 
-          if (options.resolution[0] * options.resolution[1] > 4096 * 2048)
-            throw std::runtime_error("Can't have a resolution with an area greater than 4096 * 2048");
+        if (param == "compression") {
+          if (value == "fast")
+            options.compression = PngCompression::Fast;
+          else if (value == "default")
+            options.compression = PngCompression::Default;
+          else if (value == "max")
+            options.compression = PngCompression::Max;
         }
+
+        if (param == "frames")
+          sscanf(value.c_str(), "%u", &options.frames);
+
+        if (param == "fps")
+          sscanf(value.c_str(), "%u", &options.fps);
       }
     }
 
+    if (options.frames == 0 || options.frames > g_maxFrames)
+      throw std::runtime_error("Can't have fewer than 1 or more than " + std::to_string(g_maxFrames) + " frames");
+
+    if (options.fps == 0 || options.fps > g_maxFps)
+      throw std::runtime_error("Can't have fewer than 1 or more than " + std::to_string(g_maxFps) + " fps");
+
+    if (uint64_t(options.frames) * options.resolution[0] * options.resolution[1] > g_maxAnimationPixels)
+      throw std::runtime_error("Too many frames at this resolution, try fewer frames or a smaller resolution");
+
+    if (options.localSize[0] == 0 || options.localSize[1] == 0 || uint64_t(options.localSize[0]) * options.localSize[1] > g_maxLocalInvocations)
+      throw std::runtime_error("Can't have a local size of 0 or more than " + std::to_string(g_maxLocalInvocations) + " invocations");
+
     return options;
   }
 
 
-  std::string Renderer::init(bool hlsl, std::string glslFrag) {
-    fixCode(hlsl, glslFrag);
+  Task<std::vector<uint8_t>> Renderer::render(ShaderProgram program) {
+    using Clock = std::chrono::steady_clock;
 
-    auto options = getRendererOptions(glslFrag);
+    auto lastStage = Clock::now();
+    auto lap = [&lastStage] {
+      const auto now = Clock::now();
+      const double ms = std::chrono::duration<double, std::milli>(now - lastStage).count();
+      lastStage = now;
+      return ms;
+    };
 
-    // Create instance
-    {
-      VkApplicationInfo appInfo = {
-        .sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-        .pApplicationName   = "Shadey",
-        .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-        .pEngineName        = "Shadey",
-        .engineVersion      = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion         = VK_API_VERSION_1_2
-      };
+    fixCode(program);
 
-      VkInstanceCreateInfo instanceInfo = {
-        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pApplicationInfo = &appInfo
-      };
+    m_options = getRendererOptions(program.fragment);
+
+    // Grab a render target
+    m_target = m_context.targetPool().acquire(m_options.resolution[0], m_options.resolution[1], targetFlags());
+    m_timings.parseMs = lap();
+
+    createShaderModules(program);
+    m_timings.compileMs = lap();
+
+    createPipeline();
+    m_timings.pipelineMs = lap();
+
+    // Compilation and the pipeline are shared by every frame, only drawing and encoding repeat.
+    if (m_options.frames > 1)
+      co_return co_await renderFrames();
+
+    if (tiled())
+      co_return co_await renderTiles();
+
+    recordCommands();
+    m_timings.recordMs = lap();
+
+    submit();
+
+    // Other jobs get the executor while the GPU works on ours.
+    if (!co_await m_context.gpuQueue().waitUntil(m_submission, *Executor::instance(), Clock::now() + g_gpuTimeout))
+      throw std::runtime_error("Shader took too long to render");
+    m_timings.gpuMs = lap();
+
+    auto png = encodePng(m_target->bufferMemPtr, m_options.resolution[0], m_options.resolution[1], 4 * m_options.resolution[0], m_options.compression);
+    m_timings.encodeMs = lap();
+
+    co_return png;
+  }
+
+
+  Task<std::vector<uint8_t>> Renderer::renderFrames() {
+    using Clock = std::chrono::steady_clock;
 
-      if (vkCreateInstance(&instanceInfo, nullptr, &m_instance) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create Vulkan instance");
+    auto since = [](Clock::time_point start) {
+      return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    const uint32_t width     = m_options.resolution[0];
+    const uint32_t height    = m_options.resolution[1];
+    const uint32_t slotCount = std::min(m_options.frames, g_frameRingSize);
+
+    m_frameSlots.resize(slotCount);
+    m_frameSlots[0].target = m_target;
+    for (uint32_t i = 1; i < slotCount; i++)
+      m_frameSlots[i].target = m_context.targetPool().acquire(width, height, targetFlags());
+
+    for (uint32_t frame = 0; frame < slotCount; frame++)
+      submitFrame(frame);
+
+    const auto deadline = Clock::now() + g_gpuTimeout;
+
+    ApngEncoder encoder(width, height, m_options.frames, m_options.fps, m_options.compression);
+
+    for (uint32_t frame = 0; frame < m_options.frames; frame++) {
+      FrameSlot& slot = m_frameSlots[frame % slotCount];
+
+      const auto waitStart = Clock::now();
+      if (!co_await m_context.gpuQueue().waitUntil(slot.submission, *Executor::instance(), deadline))
+        throw std::runtime_error("Shader took too long to render");
+      m_timings.gpuMs += since(waitStart);
+
+      // The other slots keep the GPU busy while this frame is encoded.
+      const auto encodeStart = Clock::now();
+      encoder.addFrame(slot.target->bufferMemPtr, 4 * width);
+      m_timings.encodeMs += since(encodeStart);
+
+      vkFreeCommandBuffers(m_device, m_commandPool, 1, &slot.commandBuffer);
+      slot.commandBuffer = VK_NULL_HANDLE;
+
+      if (frame + slotCount < m_options.frames)
+        submitFrame(frame + slotCount);
     }
 
-    // Get physical device we want
-    {
-      uint32_t deviceCount = 0;
-      vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
+    co_return encoder.finish();
+  }
+
 
-      if (deviceCount == 0)
-        throw std::runtime_error("Failed to find any Vulkan capable GPUs");
+  Task<std::vector<uint8_t>> Renderer::renderTiles() {
+    using Clock = std::chrono::steady_clock;
 
-      std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
-      vkEnumeratePhysicalDevices(m_instance, &deviceCount, physicalDevices.data());
+    auto since = [](Clock::time_point start) {
+      return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
 
-      // Pick the first one.
-      m_physDevice = physicalDevices[0];
+    const uint32_t width     = m_options.resolution[0];
+    const uint32_t height    = m_options.resolution[1];
+    const uint32_t tilesX    = (width  + g_tileSize - 1) / g_tileSize;
+    const uint32_t tilesY    = (height + g_tileSize - 1) / g_tileSize;
+    const uint32_t tileCount = tilesX * tilesY;
+
+    std::vector<VkRect2D> tiles(tileCount);
+    for (uint32_t y = 0; y < tilesY; y++) {
+      for (uint32_t x = 0; x < tilesX; x++) {
+        tiles[y * tilesX + x] = {
+          .offset = { int32_t(x * g_tileSize), int32_t(y * g_tileSize) },
+          .extent = { std::min(g_tileSize, width - x * g_tileSize), std::min(g_tileSize, height - y * g_tileSize) }
+        };
+      }
     }
 
-    // Pick our queue family
-    {
-      uint32_t queueFamilyCount = 0;
-      vkGetPhysicalDeviceQueueFamilyProperties(m_physDevice, &queueFamilyCount, nullptr);
+    // Each row of tiles is copied out as a band as soon as it's drawn, into a small ring of
+    // staging buffers, and encoded while later tiles render. Band b uses staging buffer b % ringSize.
+    const uint32_t bandCount = tilesY;
+    const uint32_t ringSize  = std::min(bandCount, g_bandRingSize);
 
-      std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-      vkGetPhysicalDeviceQueueFamilyProperties(m_physDevice, &queueFamilyCount, queueFamilies.data());
+    for (uint32_t i = 0; i < ringSize; i++)
+      m_bands.push_back(m_context.targetPool().acquire(width, g_tileSize, RenderTargetFlag_Readback));
 
-      for (uint32_t i = 0; i < queueFamilies.size(); i++) {
-        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-          m_graphicsFamily = i;
-          break;
-        }
+    auto bandRows = [&](uint32_t band) {
+      return std::min(g_tileSize, height - band * g_tileSize);
+    };
+
+    PngStreamEncoder encoder(width, height, m_options.compression);
+
+    uint32_t copied  = 0; // Bands with a copy recorded.
+    uint32_t ready   = 0; // Bands whose copy has completed.
+    uint32_t encoded = 0;
+
+    auto recordBands = [&](uint32_t end) {
+      for (; copied < end; copied++)
+        recordReadback(m_commandBuffer, m_target, m_bands[copied % ringSize]->buffer, copied * g_tileSize, bandRows(copied));
+    };
+
+    auto encodeReady = [&] {
+      const auto encodeStart = Clock::now();
+      for (; encoded < ready; encoded++)
+        encoder.addRows(m_bands[encoded % ringSize]->bufferMemPtr, bandRows(encoded), 4 * width);
+      m_timings.encodeMs += since(encodeStart);
+    };
+
+    // The budget counts our own draws on the GPU, not time spent queued behind other jobs
+    // or encoding. Wall time only matters for the hard timeout.
+    const auto   deadline = Clock::now() + g_gpuTimeout;
+    const double budgetMs = std::chrono::duration<double, std::milli>(g_gpuBudget).count();
+    double       drawMs   = 0.0;
+
+    // Without timestamps the best we have is submit to completion, queueing and all.
+    const bool timestamps = m_context.timestampPeriod() != 0.0f;
+    if (timestamps)
+      createTimestampPool(2);
+
+    // Starts with a single tile to get a feel for how heavy the shader is.
+    uint32_t rendered  = 0;
+    uint32_t batchSize = 1;
+
+    while (rendered < tileCount && drawMs < budgetMs) {
+      // A batch can't finish more bands than there are staging buffers free, it stops a tile short instead.
+      auto tileLimit = [&] {
+        return std::min(tileCount, (encoded + ringSize + 1) * tilesX - 1);
+      };
+
+      if (tileLimit() <= rendered)
+        encodeReady();
+
+      const uint32_t count = std::min(batchSize, tileLimit() - rendered);
+
+      const auto recordStart = Clock::now();
+      m_commandBuffer = beginCommands();
+      if (timestamps) {
+        vkCmdResetQueryPool(m_commandBuffer, m_timestampPool, 0, 2);
+        vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, 0);
       }
+      recordDraw(m_commandBuffer, m_target, pushConstants(0), std::span(tiles).subspan(rendered, count), rendered != 0);
+      if (timestamps)
+        vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, 1);
+      recordBands((rendered + count) / tilesX);
+      endCommands(m_commandBuffer);
+      m_timings.recordMs += since(recordStart);
+
+      const auto submitStart = Clock::now();
+      submit();
+
+      // The last batch's bands are encoded while this one renders.
+      encodeReady();
+
+      const auto waitStart = Clock::now();
+      if (!co_await m_context.gpuQueue().waitUntil(m_submission, *Executor::instance(), deadline))
+        throw std::runtime_error("Shader took too long to render");
+      m_timings.gpuMs += since(waitStart);
+
+      const double batchMs = timestamps ? timestampMs(0) : since(submitStart);
+      drawMs += batchMs;
 
-      if (m_graphicsFamily == UINT32_MAX)
-        throw std::runtime_error("No graphics queue available");
+      vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_commandBuffer);
+      m_commandBuffer = VK_NULL_HANDLE;
+
+      ready     = copied;
+      rendered += count;
+
+      const double tileMs = std::max(batchMs / count, 0.01);
+      batchSize = std::clamp(uint32_t(g_tileBatchMs / tileMs), 1u, g_maxTilesPerBatch);
     }
 
-    // Create our logical device
-    {
-      const float queuePriority = 1.0f;
+    // Bands that were never finished still get read back, skipped tiles are left as the clear colour.
+    for (;;) {
+      encodeReady();
+      if (encoded == bandCount)
+        break;
 
-      VkDeviceQueueCreateInfo queueInfo = {
-        .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = m_graphicsFamily,
-        .queueCount       = 1,
-        .pQueuePriorities = &queuePriority
-      };
+      const auto recordStart = Clock::now();
+      m_commandBuffer = beginCommands();
+      recordBands(std::min(bandCount, encoded + ringSize));
+      endCommands(m_commandBuffer);
+      m_timings.recordMs += since(recordStart);
 
-      VkPhysicalDeviceFeatures deviceFeatures = { };
+      submit();
 
-      VkDeviceCreateInfo deviceInfo = {
-        .sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos    = &queueInfo,
-        .pEnabledFeatures     = &deviceFeatures
-      };
+      const auto waitStart = Clock::now();
+      if (!co_await m_context.gpuQueue().waitUntil(m_submission, *Executor::instance(), deadline))
+        throw std::runtime_error("Shader took too long to render");
+      m_timings.gpuMs += since(waitStart);
 
-      if (vkCreateDevice(m_physDevice, &deviceInfo, nullptr, &m_device) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create Vulkan device");
+      vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_commandBuffer);
+      m_commandBuffer = VK_NULL_HANDLE;
 
-      vkGetDeviceQueue(m_device, m_graphicsFamily, 0, &m_queue);
+      ready = copied;
     }
 
-    // Create image and buffer
-    {
-      VkPhysicalDeviceMemoryProperties memProperties;
-      vkGetPhysicalDeviceMemoryProperties(m_physDevice, &memProperties);
+    auto png = encoder.finish();
 
-      uint32_t hostIndex = UINT32_MAX;
-      for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if (memProperties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-          hostIndex = i;
-          break;
-        }
-      }
+    if (rendered < tileCount) {
+      throw PartialRenderError("Ran out of GPU time after " + std::to_string(rendered) + " of " + std::to_string(tileCount) + " tiles, " +
+        "the rest are left blank", std::move(png));
+    }
 
-      uint32_t deviceIndex = UINT32_MAX;
-      for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if (memProperties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-          deviceIndex = i;
-          break;
-        }
-      }
+    co_return png;
+  }
 
-      VkImageCreateInfo imageInfo = {
-        .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType     = VK_IMAGE_TYPE_2D,
-        .format        = VK_FORMAT_R8G8B8A8_UNORM,
-        .extent        = { options.resolution[0], options.resolution[1], 1 },
-        .mipLevels     = 1,
-        .arrayLayers   = 1,
-        .samples       = VK_SAMPLE_COUNT_1_BIT,
-        .tiling        = VK_IMAGE_TILING_OPTIMAL,
-        .usage         = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
-      };
 
-      if (vkCreateImage(m_device, &imageInfo, nullptr, &m_image) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create image");
+  void Renderer::submitFrame(uint32_t frame) {
+    using Clock = std::chrono::steady_clock;
 
-      {
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(m_device, m_image, &memRequirements);
+    const auto start = Clock::now();
+    FrameSlot& slot  = m_frameSlots[frame % m_frameSlots.size()];
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = deviceIndex;
+    slot.commandBuffer = beginCommands();
+    recordRender(slot.commandBuffer, slot.target, pushConstants(frame));
+    recordReadback(slot.commandBuffer, slot.target, slot.target->buffer, 0, m_options.resolution[1]);
+    endCommands(slot.commandBuffer);
+    m_timings.recordMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
 
-        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &m_imageMemory) != VK_SUCCESS)
-          throw std::runtime_error("Failed to allocate image memory");
+    // Values only go up, so the latest one tells the destructor whether anything is still in flight.
+    slot.submission = m_context.gpuQueue().submit(slot.commandBuffer);
+    m_submission    = slot.submission;
+  }
 
-        if (vkBindImageMemory(m_device, m_image, m_imageMemory, 0) != VK_SUCCESS)
-          throw std::runtime_error("Failed to bind image memory");
-      }
 
-      VkImageViewCreateInfo imageViewInfo = {
-        .sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image    = m_image,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format   = VK_FORMAT_R8G8B8A8_UNORM,
-        .subresourceRange = {
-          .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-          .baseMipLevel   = 0,
-          .levelCount     = 1,
-          .baseArrayLayer = 0,
-          .layerCount     = 1
-        }
-      };
+  RendererPushConstants Renderer::pushConstants(uint32_t frame) const {
+    return RendererPushConstants {
+      .time       = float(frame) / float(m_options.fps),
+      .frame      = frame,
+      .resolution = { float(m_options.resolution[0]), float(m_options.resolution[1]) },
+    };
+  }
 
-      if (vkCreateImageView(m_device, &imageViewInfo, nullptr, &m_imageView) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create image view");
 
-      VkBufferCreateInfo bufferInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size  = 4 * sizeof(float) * options.resolution[0] * options.resolution[1],
-        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT
-      };
+  bool Renderer::tiled() const {
+    return !m_options.compute && m_options.frames == 1 && uint64_t(m_options.resolution[0]) * m_options.resolution[1] > g_tiledPixels;
+  }
 
-      if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create buffer");
 
-      {
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+  uint32_t Renderer::targetFlags() const {
+    if (m_options.compute)
+      return RenderTargetFlag_Storage | RenderTargetFlag_Readback;
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize  = memRequirements.size;
-        allocInfo.memoryTypeIndex = hostIndex;
+    // Tiled renders stream their rows out through staging bands, so skip the full size readback buffer.
+    if (tiled())
+      return RenderTargetFlag_Image;
 
-        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &m_bufferMemory) != VK_SUCCESS)
-          throw std::runtime_error("Failed to allocate buffer memory");
-      }
+    return RenderTargetFlag_All;
+  }
+
+
+  Task<RendererBenchResult> Renderer::bench(ShaderProgram program, uint32_t iterations, uint32_t width, uint32_t height) {
+    using Clock = std::chrono::steady_clock;
+
+    auto toMs = [](Clock::duration duration) {
+      return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    const float timestampPeriod = m_context.timestampPeriod();
+    if (timestampPeriod == 0.0f)
+      throw std::runtime_error("This GPU can't time shaders");
 
-      if (vkBindBufferMemory(m_device, m_buffer, m_bufferMemory, 0) != VK_SUCCESS)
-        throw std::runtime_error("Failed to bind buffer memory");
+    fixCode(program);
 
-      if (vkMapMemory(m_device, m_bufferMemory, 0, VK_WHOLE_SIZE, 0, &m_bufferMemPtr) != VK_SUCCESS)
-        throw std::runtime_error("Failed to map buffer memory");
+    m_options = getRendererOptions(program.fragment);
+
+    if (width && height) {
+      checkResolution(width, height);
+      m_options.resolution[0] = width;
+      m_options.resolution[1] = height;
     }
 
-    // Create shaders
-    {
-      auto CreateModule = [&](bool hlsl, bool fragment, const std::string& glsl) {
-        auto spv = compileShader(hlsl, fragment, glsl);
+    m_target = m_context.targetPool().acquire(m_options.resolution[0], m_options.resolution[1], m_options.compute ? RenderTargetFlag_Storage : RenderTargetFlag_Image);
 
-        VkShaderModuleCreateInfo moduleInfo = {
-          .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-          .codeSize = spv.size(),
-          .pCode    = reinterpret_cast<const uint32_t*>(spv.data())
-        };
+    RendererBenchResult result = {
+      .width   = m_options.resolution[0],
+      .height  = m_options.resolution[1],
+      .compute = m_options.compute,
+    };
 
-        VkShaderModule shaderModule = VK_NULL_HANDLE;
-        if (vkCreateShaderModule(m_device, &moduleInfo, nullptr, &shaderModule))
-          throw std::runtime_error("Failed to create shader module");
+    // Cache hits would only time a hash lookup, useless for comparing variants.
+    m_uncached = true;
 
-        return shaderModule;
-      };
+    const auto start = Clock::now();
+    createShaderModules(program);
+
+    const auto compiled = Clock::now();
+    createPipeline();
+
+    const auto built = Clock::now();
+    result.compileMs  = toMs(compiled - start);
+    result.pipelineMs = toMs(built - compiled);
+
+    createQueryPools(iterations);
+
+    m_commandBuffer = beginCommands();
+
+    vkCmdResetQueryPool(m_commandBuffer, m_timestampPool, 0, iterations * 2);
+    if (m_statisticsPool != VK_NULL_HANDLE)
+      vkCmdResetQueryPool(m_commandBuffer, m_statisticsPool, 0, iterations);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+      vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, i * 2);
+      if (m_statisticsPool != VK_NULL_HANDLE)
+        vkCmdBeginQuery(m_commandBuffer, m_statisticsPool, i, 0);
 
-      m_vertModule = CreateModule(false, false, g_vertexShaders[options.vertexType]);
-      m_fragModule = CreateModule(hlsl, true, glslFrag);
+      recordRender(m_commandBuffer, m_target, pushConstants(0));
+
+      if (m_statisticsPool != VK_NULL_HANDLE)
+        vkCmdEndQuery(m_commandBuffer, m_statisticsPool, i);
+      vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, i * 2 + 1);
     }
 
-    // Create pipeline layout
-    {
-      VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
-      };
+    endCommands(m_commandBuffer);
+    submit();
+
+    // Every iteration is one command buffer, so it gets the same hard limit as a render.
+    if (!co_await m_context.gpuQueue().waitUntil(m_submission, *Executor::instance(), Clock::now() + g_gpuTimeout))
+      throw std::runtime_error("Shader took too long to benchmark, try fewer iterations or a smaller resolution");
+
+    // Already complete, so no need to wait on the results.
+    result.gpuMs.resize(iterations);
+    for (uint32_t i = 0; i < iterations; i++)
+      result.gpuMs[i] = timestampMs(i * 2);
 
-      if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_layout) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create pipeline layout");
+    if (m_statisticsPool != VK_NULL_HANDLE) {
+      result.invocations.resize(iterations);
+      if (vkGetQueryPoolResults(m_device, m_statisticsPool, 0, iterations, result.invocations.size() * sizeof(uint64_t), result.invocations.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        throw std::runtime_error("Failed to read pipeline statistics");
     }
 
-    // Create renderpass
-    {
-      VkAttachmentDescription colorAttachment = {
-        .format         = VK_FORMAT_R8G8B8A8_UNORM,
-        .samples        = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout    = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      };
+    co_return result;
+  }
 
-      VkAttachmentReference reference = {
-        .attachment = 0,
-        .layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-      };
 
-      VkSubpassDescription subpass = {
-        .pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments    = &reference
-      };
+  void Renderer::createTimestampPool(uint32_t queryCount) {
+    VkQueryPoolCreateInfo timestampInfo = {
+      .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = queryCount
+    };
 
-      VkRenderPassCreateInfo renderPassInfo = {
-        .sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments    = &colorAttachment,
-        .subpassCount    = 1,
-        .pSubpasses      = &subpass
-      };
+    if (vkCreateQueryPool(m_device, &timestampInfo, nullptr, &m_timestampPool) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create timestamp query pool");
+  }
+
+
+  double Renderer::timestampMs(uint32_t firstQuery) {
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(m_device, m_timestampPool, firstQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+      throw std::runtime_error("Failed to read timestamps");
+
+    const uint32_t validBits = m_context.timestampValidBits();
+    const uint64_t mask      = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    const uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+    return double(ticks) * double(m_context.timestampPeriod()) / 1'000'000.0;
+  }
+
+
+  void Renderer::createQueryPools(uint32_t iterations) {
+    createTimestampPool(iterations * 2);
+
+    if (!m_context.pipelineStatistics())
+      return;
+
+    VkQueryPoolCreateInfo statisticsInfo = {
+      .sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount         = iterations,
+      .pipelineStatistics = VkQueryPipelineStatisticFlags(m_options.compute
+        ? VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT
+        : VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+    };
+
+    if (vkCreateQueryPool(m_device, &statisticsInfo, nullptr, &m_statisticsPool) != VK_SUCCESS)
+      throw std::runtime_error("Failed to create pipeline statistics query pool");
+  }
+
+
+  void Renderer::createShaderModules(const ShaderProgram& program) {
+    if (m_options.compute) {
+      auto spv = compile(program.hlsl, ShaderStage_Compute, program.hlsl ? program.fragment : fixComputeCode(program.fragment, m_options.localSize));
 
-      if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderpass) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create render pass");
+      // The shader's own local_size or [numthreads] wins over the directive.
+      if (!spirvLocalSize(spv, m_localSize))
+        throw std::runtime_error("Compute shaders need a fixed local size");
+
+      m_compModule = createShaderModule(spv);
+      return;
     }
 
-    // Create pipeline
-    {
-      VkPipelineShaderStageCreateInfo stages[2] = {
-        {
-          .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-          .stage  = VK_SHADER_STAGE_VERTEX_BIT,
-          .module = m_vertModule,
-          .pName = "main"
-        },
-        {
-          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-          .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-          .module = m_fragModule,
-          .pName = "main"
-        },
-      };
+    m_fragModule = createShaderModule(program.hlsl, ShaderStage_Fragment, program.fragment);
 
-      VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
-      };
+    // Without a vertex stage of its own the job uses the context's built-in one.
+    if (!program.vertex.empty())
+      m_vertModule = createShaderModule(program.hlsl, ShaderStage_Vertex, program.vertex);
+  }
 
-      VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
-        .sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
-      };
 
-      VkViewport viewport = {
-        .x       = 0.0f,
-        .y       = 0.0f,
-        .width   = float(options.resolution[0]),
-        .height  = float(options.resolution[1]),
-        .minDepth = 0.0f,
-        .maxDepth = 0.0f,
-      };
+  VkShaderModule Renderer::createShaderModule(bool hlsl, ShaderStage stage, const std::string& code) {
+    return createShaderModule(compile(hlsl, stage, code));
+  }
 
-      VkRect2D scissor = {
-        .extent = { options.resolution[0], options.resolution[1] }
-      };
 
-      VkPipelineViewportStateCreateInfo viewportState = {
-        .sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .pViewports    = &viewport,
-        .scissorCount  = 1,
-        .pScissors     = &scissor
-      };
+  std::vector<uint8_t> Renderer::compile(bool hlsl, ShaderStage stage, const std::string& code) {
+    return m_uncached ? compileShaderUncached(hlsl, stage, code) : compileShader(hlsl, stage, code);
+  }
 
-      VkPipelineRasterizationStateCreateInfo rasterizer = {
-        .sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .cullMode    = VK_CULL_MODE_BACK_BIT,
-        .frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-        .lineWidth   = 1.0f
-      };
 
-      VkPipelineMultisampleStateCreateInfo multisampling = {
-        .sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        .minSampleShading     = 1.0f
-      };
+  VkShaderModule Renderer::createShaderModule(const std::vector<uint8_t>& spv) {
+    VkShaderModuleCreateInfo moduleInfo = {
+      .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = spv.size(),
+      .pCode    = reinterpret_cast<const uint32_t*>(spv.data())
+    };
 
-      VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-                          VK_COLOR_COMPONENT_G_BIT |
-                          VK_COLOR_COMPONENT_B_BIT |
-                          VK_COLOR_COMPONENT_A_BIT,
-      };
+    VkShaderModule module = VK_NULL_HANDLE;
+    if (vkCreateShaderModule(m_device, &moduleInfo, nullptr, &module))
+      throw std::runtime_error("Failed to create shader module");
 
-      VkPipelineColorBlendStateCreateInfo colorBlending = {
-        .sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments    = &colorBlendAttachment
-      };
+    return module;
+  }
 
-      VkGraphicsPipelineCreateInfo pipelineInfo = {
-        .sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount          = 2,
-        .pStages             = stages,
-        .pVertexInputState   = &vertexInputInfo,
-        .pInputAssemblyState = &inputAssembly,
-        .pViewportState      = &viewportState,
-        .pRasterizationState = &rasterizer,
-        .pMultisampleState   = &multisampling,
-        .pDepthStencilState  = nullptr,
-        .pColorBlendState    = &colorBlending,
-        .pDynamicState       = nullptr,
-        .layout              = m_layout,
-        .renderPass          = m_renderpass,
-      };
 
-      if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create graphics pipeline");
+  void Renderer::createPipeline() {
+    if (m_options.compute) {
+      createComputePipeline();
+      return;
     }
 
-    // Create framebuffer
-    {
-      VkFramebufferCreateInfo framebufferInfo = {
-        .sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .renderPass      = m_renderpass,
-        .attachmentCount = 1,
-        .pAttachments    = &m_imageView,
-        .width           = options.resolution[0],
-        .height          = options.resolution[1],
-        .layers          = 1
-      };
+    VkRenderPass renderPass = m_context.renderPass(g_renderFormat);
+
+    VkPipelineShaderStageCreateInfo stages[2] = {
+      {
+        .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage  = VK_SHADER_STAGE_VERTEX_BIT,
+        .module = m_vertModule != VK_NULL_HANDLE ? m_vertModule : m_context.vertexModule(m_options.vertexType),
+        .pName = "main"
+      },
+      {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+        .module = m_fragModule,
+        .pName = "main"
+      },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+      .sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+    };
+
+    // Viewport and scissor are dynamic so the pipeline doesn't
+    // depend on resolution and the pipeline cache hits more often.
+    VkPipelineViewportStateCreateInfo viewportState = {
+      .sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount  = 1
+    };
+
+    const VkDynamicState dynamicStates[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+      .sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = uint32_t(std::size(dynamicStates)),
+      .pDynamicStates    = dynamicStates
+    };
 
-      if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_framebuffer) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create framebuffer");
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .cullMode    = VK_CULL_MODE_BACK_BIT,
+      .frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      .lineWidth   = 1.0f
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      .minSampleShading     = 1.0f
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+                        VK_COLOR_COMPONENT_G_BIT |
+                        VK_COLOR_COMPONENT_B_BIT |
+                        VK_COLOR_COMPONENT_A_BIT,
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+      .sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments    = &colorBlendAttachment
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+      .sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .stageCount          = 2,
+      .pStages             = stages,
+      .pVertexInputState   = &vertexInputInfo,
+      .pInputAssemblyState = &inputAssembly,
+      .pViewportState      = &viewportState,
+      .pRasterizationState = &rasterizer,
+      .pMultisampleState   = &multisampling,
+      .pDepthStencilState  = nullptr,
+      .pColorBlendState    = &colorBlending,
+      .pDynamicState       = &dynamicState,
+      .layout              = m_context.pipelineLayout(),
+      .renderPass          = renderPass,
+    };
+
+    m_pipeline = m_context.createGraphicsPipeline(pipelineInfo, !m_uncached);
+  }
+
+
+  void Renderer::createComputePipeline() {
+    // One invocation per pixel, anything deeper would just write them again.
+    if (m_localSize[2] != 1)
+      throw std::runtime_error("Compute shaders need a local size of 1 in z");
+
+    const uint32_t* maxSize = m_context.maxComputeWorkGroupSize();
+    for (uint32_t i = 0; i < 3; i++) {
+      if (m_localSize[i] == 0 || m_localSize[i] > maxSize[i])
+        throw std::runtime_error("This GPU can't have a local size of " + std::to_string(m_localSize[i]) + " in " + "xyz"[i]);
     }
 
-    // Create command pool
-    {
-      VkCommandPoolCreateInfo commandPoolInfo = {
-        .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .queueFamilyIndex = m_graphicsFamily
-      };
+    if (uint64_t(m_localSize[0]) * m_localSize[1] * m_localSize[2] > m_context.maxComputeInvocations())
+      throw std::runtime_error("This GPU can't have more than " + std::to_string(m_context.maxComputeInvocations()) + " invocations in a local size");
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {
+        .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = m_compModule,
+        .pName  = "main"
+      },
+      .layout = m_context.computePipelineLayout()
+    };
 
-      if (vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
-        throw std::runtime_error("Failed to create command pool");
+    m_pipeline = m_context.createComputePipeline(pipelineInfo, !m_uncached);
+  }
+
+
+  void Renderer::recordCommands() {
+    m_commandBuffer = beginCommands();
+    recordRender(m_commandBuffer, m_target, pushConstants(0));
+    recordReadback(m_commandBuffer, m_target, m_target->buffer, 0, m_options.resolution[1]);
+    endCommands(m_commandBuffer);
+  }
+
+
+  VkCommandBuffer Renderer::beginCommands() {
+    // Grab a command pool, animations allocate every frame's commands from the same one
+    if (m_commandPool == VK_NULL_HANDLE)
+      m_commandPool = m_context.acquireCommandPool();
+
+    VkCommandBufferAllocateInfo commandBufferInfo = {
+      .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool        = m_commandPool,
+      .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1
+    };
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(m_device, &commandBufferInfo, &commandBuffer) != VK_SUCCESS)
+      throw std::runtime_error("Failed to allocate command buffers");
+
+    VkCommandBufferBeginInfo beginInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+      throw std::runtime_error("Failed to begin recording command buffer");
     }
 
-    // Create command buffers
-    {
-      VkCommandBufferAllocateInfo commandBufferInfo = {
-        .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool        = m_commandPool,
-        .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
-      };
+    return commandBuffer;
+  }
 
-      if (vkAllocateCommandBuffers(m_device, &commandBufferInfo, &m_commandBuffer) != VK_SUCCESS)
-        throw std::runtime_error("Failed to allocate command buffers");
 
-      VkCommandBufferBeginInfo beginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-      };
+  void Renderer::recordDraw(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants, std::span<const VkRect2D> tiles, bool keepContents) {
+    VkRenderPass renderPass = m_context.renderPass(g_renderFormat, keepContents);
 
-      if (vkBeginCommandBuffer(m_commandBuffer, &beginInfo) != VK_SUCCESS)
-        throw std::runtime_error("Failed to begin recording command buffer");
-
-      VkRenderPassBeginInfo renderPassInfo = {
-        .sType       = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass  = m_renderpass,
-        .framebuffer = m_framebuffer,
-        .renderArea = {
-          .offset = { 0, 0 },
-          .extent = { options.resolution[0], options.resolution[1] }
-        },
-        .clearValueCount = 1,
-        .pClearValues    = &options.clearColor
-      };
+    VkRenderPassBeginInfo renderPassInfo = {
+      .sType       = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass  = renderPass,
+      .framebuffer = target->framebuffer,
+      .renderArea = {
+        .offset = { 0, 0 },
+        .extent = { m_options.resolution[0], m_options.resolution[1] }
+      },
+      .clearValueCount = 1,
+      .pClearValues    = &m_options.clearColor
+    };
 
-      VkImageMemoryBarrier barrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = m_image,
-        .subresourceRange = {
-          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-          .baseMipLevel = 0,
-          .levelCount = 1,
-          .baseArrayLayer = 0,
-          .layerCount = 1
-        }
+    // Waits on any earlier draw to the same target, benchmarks draw several times in a row.
+    // Later batches of tiles keep the earlier ones, which the last pass left ready for readback.
+    VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .dstAccessMask = VkAccessFlags(keepContents ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT),
+      .oldLayout = keepContents ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = target->image,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+
+    // Band copies from the last batch read the target too, the layout change has to wait for them.
+    const VkPipelineStageFlags srcStages = keepContents
+      ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT
+      : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+    vkCmdPushConstants(commandBuffer, m_context.pipelineLayout(), RendererPushConstants::Stages, 0, sizeof(constants), &constants);
+
+    VkViewport viewport = {
+      .x        = 0.0f,
+      .y        = 0.0f,
+      .width    = float(m_options.resolution[0]),
+      .height   = float(m_options.resolution[1]),
+      .minDepth = 0.0f,
+      .maxDepth = 0.0f,
+    };
+
+    VkRect2D scissor = {
+      .extent = { m_options.resolution[0], m_options.resolution[1] }
+    };
+
+    if (tiles.empty())
+      tiles = std::span(&scissor, 1);
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    // The viewport always covers the whole target, so tiles see the same coordinates a full draw would.
+    for (const VkRect2D& tile : tiles) {
+      vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+      vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+
+  void Renderer::recordDispatch(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants) {
+    // The shader overwrites everything, so only waits on earlier work that used the target.
+    VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = target->image,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkDescriptorSet descriptorSet = storageSet(target);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_context.computePipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_context.computePipelineLayout(), RendererPushConstants::ComputeStages, 0, sizeof(constants), &constants);
+
+    // Edge groups run past the target, imageStore drops writes that are out of bounds.
+    vkCmdDispatch(commandBuffer,
+      (m_options.resolution[0] + m_localSize[0] - 1) / m_localSize[0],
+      (m_options.resolution[1] + m_localSize[1] - 1) / m_localSize[1],
+      1);
+
+    // Leaves the target the way a render pass would for recordReadback.
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout     = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+
+  void Renderer::recordRender(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants) {
+    if (m_options.compute)
+      recordDispatch(commandBuffer, target, constants);
+    else
+      recordDraw(commandBuffer, target, constants);
+  }
+
+
+  VkDescriptorSet Renderer::storageSet(RenderTarget* target) {
+    for (const auto& [setTarget, set] : m_storageSets) {
+      if (setTarget == target)
+        return set;
+    }
+
+    // Sized for an animation's ring of targets, the most one job uses.
+    if (m_descriptorPool == VK_NULL_HANDLE) {
+      VkDescriptorPoolSize poolSize = {
+        .type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .descriptorCount = g_frameRingSize
       };
 
-      vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-      vkCmdBeginRenderPass(m_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-      vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-      vkCmdDraw(m_commandBuffer, 3, 1, 0, 0);
-      vkCmdEndRenderPass(m_commandBuffer);
-
-      VkBufferImageCopy region = {
-        .bufferOffset      = 0,
-        .bufferRowLength   = 0,
-        .bufferImageHeight = 0,
-
-        .imageSubresource = {
-          .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-          .mipLevel       = 0,
-          .baseArrayLayer = 0,
-          .layerCount     = 1,
-        },
-        .imageOffset = { 0, 0, 0 },
-        .imageExtent = { options.resolution[0], options.resolution[1], 1 }
+      VkDescriptorPoolCreateInfo poolInfo = {
+        .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets       = g_frameRingSize,
+        .poolSizeCount = 1,
+        .pPoolSizes    = &poolSize
       };
-      vkCmdCopyImageToBuffer(m_commandBuffer, m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_buffer, 1, &region);
 
-      if (vkEndCommandBuffer(m_commandBuffer) != VK_SUCCESS)
-        throw std::runtime_error("Failed to record command buffer");
+      if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create descriptor pool");
     }
-    
-    // Submit
-    {
 
+    VkDescriptorSetLayout setLayout = m_context.storageImageLayout();
 
-      VkSubmitInfo submitInfo = {
-        .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount   = 1,
-        .pCommandBuffers      = &m_commandBuffer,
-      };
+    VkDescriptorSetAllocateInfo allocInfo = {
+      .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool     = m_descriptorPool,
+      .descriptorSetCount = 1,
+      .pSetLayouts        = &setLayout
+    };
+
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, &set) != VK_SUCCESS)
+      throw std::runtime_error("Failed to allocate descriptor set");
+
+    VkDescriptorImageInfo imageInfo = {
+      .imageView   = target->imageView,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
 
-      if (vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit queue");
+    VkWriteDescriptorSet write = {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = set,
+      .dstBinding      = 0,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .pImageInfo      = &imageInfo
+    };
 
-      vkQueueWaitIdle(m_queue);
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
 
-      static std::atomic<uint32_t> index = 0;
+    m_storageSets.emplace_back(target, set);
+    return set;
+  }
 
-      std::string name = "temp_" + std::to_string(index.fetch_add(1)) + std::string(".png");
 
-      stbi_write_png(name.c_str(), options.resolution[0], options.resolution[1], 4, m_bufferMemPtr, 4 * options.resolution[0]);
+  void Renderer::recordReadback(VkCommandBuffer commandBuffer, RenderTarget* target, VkBuffer buffer, uint32_t firstRow, uint32_t rowCount) {
+    VkBufferImageCopy region = {
+      .bufferOffset      = 0,
+      .bufferRowLength   = 0,
+      .bufferImageHeight = 0,
+
+      .imageSubresource = {
+        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+        .mipLevel       = 0,
+        .baseArrayLayer = 0,
+        .layerCount     = 1,
+      },
+      .imageOffset = { 0, int32_t(firstRow), 0 },
+      .imageExtent = { m_options.resolution[0], rowCount, 1 }
+    };
 
-      return name;
-    }
+    // Tiled renders read back after draws in earlier submissions.
+    VkMemoryBarrier barrier = {
+      .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkCmdCopyImageToBuffer(commandBuffer, target->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+  }
+
+
+  void Renderer::endCommands(VkCommandBuffer commandBuffer) {
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+      throw std::runtime_error("Failed to record command buffer");
+  }
+
+
+  void Renderer::submit() {
+    // Goes out with whatever else is ready, see GpuQueue.
+    m_submission = m_context.gpuQueue().submit(m_commandBuffer);
   }
 
 }
\ No newline at end of file
@@ -2,10 +2,22 @@
 
 #include <vulkan/vulkan.h>
 #include <cstdint>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "non_copyable.h"
+#include "png_encoder.h"
+#include "shader_helpers.h"
+#include "task.h"
 
 namespace shadey {
 
+  class RenderContext;
+  struct RenderTarget;
+
   enum RendererVertexType {
     RendererVertexType_Quad,
     RendererVertexType_Triangle,
@@ -16,43 +28,198 @@ namespace shadey {
     VkClearValue clearColor;
     RendererVertexType vertexType;
     uint32_t resolution[2];
+    PngCompression compression;
+    // More than one frame renders an animated PNG.
+    uint32_t frames;
+    uint32_t fps;
+    // Dispatches a compute shader writing a storage image instead of drawing.
+    bool compute;
+    uint32_t localSize[2];
   };
 
-  class Renderer {
+  // Pushed before every draw. Shaders read them with
+  //   layout(push_constant) uniform Shadey { float time; uint frame; vec2 resolution; } shadey;
+  // or in HLSL
+  //   [[vk::push_constant]] struct { float time; uint frame; float2 resolution; } shadey;
+  //
+  // Compute shaders get the same and write their output to
+  //   layout(binding = 0, rgba8) uniform writeonly image2D shadeyOutput;
+  // or in HLSL
+  //   [[vk::binding(0)]] RWTexture2D<float4> shadeyOutput;
+  struct RendererPushConstants {
+    static constexpr VkShaderStageFlags Stages        = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    static constexpr VkShaderStageFlags ComputeStages = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    // Seconds since the first frame.
+    float    time;
+    uint32_t frame;
+    float    resolution[2];
+  };
 
+  struct RendererBenchResult {
+    uint32_t              width;
+    uint32_t              height;
+    // Both skip the SPIR-V and pipeline caches, though a driver may still keep its own.
+    double                compileMs;
+    double                pipelineMs;
+    std::vector<double>   gpuMs;
+    bool                  compute;
+    // Fragment or compute shader invocations per draw.
+    // Empty if the device doesn't support pipeline statistics.
+    std::vector<uint64_t> invocations;
+  };
+
+  // Wall time spent in each stage of the last render().
+  struct RendererTimings {
+    double parseMs;
+    double compileMs;
+    double pipelineMs;
+    double recordMs;
+    // Submit to completion, including time queued behind other jobs.
+    double gpuMs;
+    double encodeMs;
+  };
+
+  // Thrown when a render ran out of GPU time part way through, with what it did get done.
+  class PartialRenderError : public std::runtime_error {
   public:
+    PartialRenderError(const std::string& message, std::vector<uint8_t> png)
+      : std::runtime_error(message)
+      , m_png(std::move(png)) { }
+
+    const std::vector<uint8_t>& png() const { return m_png; }
+
+  private:
+
+    std::vector<uint8_t> m_png;
+  };
 
-    Renderer();
+  // Per-job render state. Everything long-lived comes from the RenderContext.
+  class Renderer : public NonCopyable {
+
+  public:
+
+    Renderer(RenderContext& context);
 
     ~Renderer();
 
-    std::string init(bool hlsl, std::string glslFrag);
+    // Renders the fragment shader and returns the result as an encoded PNG, animated if it asks for frames.
+    // CPU stages run inline, the GPU wait suspends instead of blocking a thread.
+    // Large renders that run out of GPU time throw a PartialRenderError.
+    Task<std::vector<uint8_t>> render(ShaderProgram program);
+
+    // Draws the shader `iterations` times without reading back, timing each draw on the GPU.
+    // A zero width or height keeps the resolution from the shader's directives.
+    Task<RendererBenchResult> bench(ShaderProgram program, uint32_t iterations, uint32_t width, uint32_t height);
+
+    const RendererTimings& timings() const { return m_timings; }
+
+    const RendererOptions& options() const { return m_options; }
 
     static void fixCode(bool hlsl, std::string& code);
 
+    static void fixCode(ShaderProgram& program);
+
+    static void checkResolution(uint32_t width, uint32_t height);
+
     static RendererOptions getRendererOptions(const std::string& code);
 
   private:
 
-    VkInstance       m_instance       = VK_NULL_HANDLE;
-    VkPhysicalDevice m_physDevice     = VK_NULL_HANDLE;
-    uint32_t         m_graphicsFamily = UINT32_MAX;
+    void createShaderModules(const ShaderProgram& program);
+
+    VkShaderModule createShaderModule(bool hlsl, ShaderStage stage, const std::string& code);
+
+    VkShaderModule createShaderModule(const std::vector<uint8_t>& spv);
+
+    // compileShader, or compileShaderUncached when benchmarking.
+    std::vector<uint8_t> compile(bool hlsl, ShaderStage stage, const std::string& code);
+
+    void createPipeline();
+
+    // A compute pipeline for compute shaders, which need no render pass or framebuffer.
+    void createComputePipeline();
+
+    void createQueryPools(uint32_t iterations);
+
+    void createTimestampPool(uint32_t queryCount);
+
+    // GPU time between a pair of timestamps starting at firstQuery, which must have completed.
+    double timestampMs(uint32_t firstQuery);
+
+    // Renders and encodes frames through a small ring of targets, see render().
+    Task<std::vector<uint8_t>> renderFrames();
+
+    void submitFrame(uint32_t frame);
+
+    // Draws the target in scissored tiles under a GPU time budget, encoding rows of tiles as they finish.
+    Task<std::vector<uint8_t>> renderTiles();
+
+    RendererPushConstants pushConstants(uint32_t frame) const;
+
+    // Large graphics renders are tiled, see renderTiles().
+    bool tiled() const;
+
+    uint32_t targetFlags() const;
+
+    void recordCommands();
+
+    VkCommandBuffer beginCommands();
+
+    // Draws every tile with one render pass, or the whole target if there are none.
+    // keepContents loads what earlier passes drew instead of clearing it.
+    void recordDraw(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants, std::span<const VkRect2D> tiles = { }, bool keepContents = false);
+
+    // Dispatches the compute shader over the whole target, leaving it ready for readback.
+    void recordDispatch(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants);
+
+    // recordDispatch or recordDraw, whichever the shader needs.
+    void recordRender(VkCommandBuffer commandBuffer, RenderTarget* target, const RendererPushConstants& constants);
+
+    // Binds the target as a compute shader's output, one set per target and job.
+    VkDescriptorSet storageSet(RenderTarget* target);
+
+    // Copies rowCount rows of the target starting at firstRow, tightly packed at the start of buffer.
+    void recordReadback(VkCommandBuffer commandBuffer, RenderTarget* target, VkBuffer buffer, uint32_t firstRow, uint32_t rowCount);
+
+    void endCommands(VkCommandBuffer commandBuffer);
+
+    void submit();
+
+    struct FrameSlot {
+      RenderTarget*   target        = nullptr;
+      VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+      uint64_t        submission    = 0;
+    };
+
+    RenderContext&   m_context;
+    RendererOptions  m_options        = { };
+    RendererTimings  m_timings        = { };
     VkDevice         m_device         = VK_NULL_HANDLE;
-    VkQueue          m_queue          = VK_NULL_HANDLE;
-    VkImage          m_image          = VK_NULL_HANDLE;
-    VkDeviceMemory   m_imageMemory    = VK_NULL_HANDLE;
-    VkImageView      m_imageView      = VK_NULL_HANDLE;
-    VkBuffer         m_buffer         = VK_NULL_HANDLE;
-    VkDeviceMemory   m_bufferMemory   = VK_NULL_HANDLE;
-    void*            m_bufferMemPtr   = nullptr;
+    RenderTarget*    m_target         = nullptr;
+    // Benchmarks skip the SPIR-V and pipeline caches, so they time the real work.
+    bool             m_uncached       = false;
     VkShaderModule   m_vertModule     = VK_NULL_HANDLE;
     VkShaderModule   m_fragModule     = VK_NULL_HANDLE;
-    VkPipelineLayout m_layout         = VK_NULL_HANDLE;
-    VkRenderPass     m_renderpass     = VK_NULL_HANDLE;
+    VkShaderModule   m_compModule     = VK_NULL_HANDLE;
+    // Compute only, as compiled rather than as the directive asked.
+    uint32_t         m_localSize[3]   = { };
     VkPipeline       m_pipeline       = VK_NULL_HANDLE;
-    VkFramebuffer    m_framebuffer    = VK_NULL_HANDLE;
     VkCommandPool    m_commandPool    = VK_NULL_HANDLE;
     VkCommandBuffer  m_commandBuffer  = VK_NULL_HANDLE;
+    uint64_t         m_submission     = 0;
+    VkQueryPool      m_timestampPool  = VK_NULL_HANDLE;
+    VkQueryPool      m_statisticsPool = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+
+    // Animations only, the first slot renders into m_target.
+    std::vector<FrameSlot> m_frameSlots;
+
+    // Tiled renders only, readback-only targets one row of tiles high.
+    std::vector<RenderTarget*> m_bands;
+
+    // Compute renders only.
+    std::vector<std::pair<RenderTarget*, VkDescriptorSet>> m_storageSets;
   };
 
 }
\ No newline at end of file
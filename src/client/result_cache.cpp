@@ -0,0 +1,183 @@
+#include "result_cache.h"
+#include "executor.h"
+
+namespace shadey {
+
+  namespace {
+    static constexpr size_t g_defaultCacheBytes = 64 * 1024 * 1024;
+
+    // Differences that can't change the rendered image shouldn't miss the cache:
+    // line endings, trailing whitespace and blank lines at either end.
+    static std::string normalizeSource(const std::string& code) {
+      std::string normalized;
+      normalized.reserve(code.length());
+
+      size_t pendingNewlines = 0;
+      size_t lineStart       = 0;
+
+      while (lineStart <= code.length()) {
+        size_t lineEnd = code.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+          lineEnd = code.length();
+
+        size_t contentEnd = lineEnd;
+        while (contentEnd > lineStart && (code[contentEnd - 1] == ' ' || code[contentEnd - 1] == '\t' || code[contentEnd - 1] == '\r'))
+          contentEnd--;
+
+        if (contentEnd == lineStart) {
+          // Blank lines only count once there is something after them.
+          if (!normalized.empty())
+            pendingNewlines++;
+        }
+        else {
+          normalized.append(pendingNewlines, '\n');
+          pendingNewlines = 1;
+          normalized.append(code, lineStart, contentEnd - lineStart);
+        }
+
+        lineStart = lineEnd + 1;
+      }
+
+      return normalized;
+    }
+  }
+
+  ResultCache::ResultCache(size_t maxBytes)
+    : m_memory(maxBytes) { }
+
+
+  ResultCache* ResultCache::instance() {
+    static std::unique_ptr<ResultCache> s_instance =
+      std::make_unique<ResultCache>(g_defaultCacheBytes);
+
+    return s_instance.get();
+  }
+
+
+  Hash128 ResultCache::key(const ShaderProgram& program, const RendererOptions& options) {
+    return Hasher128()
+      .updateValue(program.hlsl)
+      .update(normalizeSource(program.fragment))
+      .update(normalizeSource(program.vertex))
+      .updateValue(options.clearColor.color.float32)
+      .updateValue(options.vertexType)
+      .updateValue(options.resolution)
+      .updateValue(options.compression)
+      .updateValue(options.frames)
+      .updateValue(options.fps)
+      .updateValue(options.compute)
+      .updateValue(options.localSize)
+      .finish();
+  }
+
+
+  EncodedImage ResultCache::find(const Hash128& key) {
+    std::lock_guard lock(m_mutex);
+
+    auto entry = m_memory.find(key);
+    if (!entry)
+      return nullptr;
+
+    m_hits++;
+    return *entry;
+  }
+
+
+  Task<EncodedImage> ResultCache::findOrRender(Hash128 key, std::function<Task<std::vector<uint8_t>>()> render) {
+    EncodedImage              cached;
+    std::shared_ptr<InFlight> flight;
+    bool                      owner = false;
+    {
+      std::lock_guard lock(m_mutex);
+
+      if (auto entry = m_memory.find(key)) {
+        cached = *entry;
+      }
+      else {
+        auto [iter, inserted] = m_inFlight.try_emplace(key);
+        if (inserted)
+          iter->second = std::make_shared<InFlight>();
+
+        flight = iter->second;
+        owner  = inserted;
+      }
+    }
+
+    if (cached) {
+      m_hits++;
+      co_return cached;
+    }
+
+    if (!owner) {
+      m_coalesced++;
+      co_await JoinAwaiter{ this, flight.get() };
+
+      if (flight->error)
+        std::rethrow_exception(flight->error);
+
+      co_return flight->image;
+    }
+
+    m_misses++;
+
+    EncodedImage       image;
+    std::exception_ptr error;
+    try {
+      image = std::make_shared<const std::vector<uint8_t>>(co_await render());
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    std::vector<std::coroutine_handle<>> waiters;
+    {
+      std::lock_guard lock(m_mutex);
+
+      if (image)
+        m_memory.insert(key, image, image->size());
+
+      flight->done  = true;
+      flight->image = image;
+      flight->error = error;
+      waiters.swap(flight->waiters);
+
+      m_inFlight.erase(key);
+    }
+
+    for (auto waiter : waiters)
+      Executor::instance()->post(waiter);
+
+    if (error)
+      std::rethrow_exception(error);
+
+    co_return image;
+  }
+
+
+  bool ResultCache::JoinAwaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    std::lock_guard lock(cache->m_mutex);
+
+    // Finished between us joining and getting here, carry straight on.
+    if (flight->done)
+      return false;
+
+    flight->waiters.push_back(awaiting);
+    return true;
+  }
+
+
+  ResultCacheStats ResultCache::stats() {
+    std::lock_guard lock(m_mutex);
+
+    return ResultCacheStats {
+      .hits      = m_hits,
+      .coalesced = m_coalesced,
+      .misses    = m_misses,
+      .entries   = m_memory.size(),
+      .bytes     = m_memory.cost(),
+      .maxBytes  = m_memory.maxCost(),
+      .evictions = m_memory.evictions(),
+    };
+  }
+
+}
\ No newline at end of file
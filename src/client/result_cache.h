@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hash_helpers.h"
+#include "lru_cache.h"
+#include "non_copyable.h"
+#include "renderer.h"
+#include "task.h"
+
+namespace shadey {
+
+  // Encoded images are shared rather than copied, hits only bump a refcount.
+  using EncodedImage = std::shared_ptr<const std::vector<uint8_t>>;
+
+  struct ResultCacheStats {
+    uint64_t hits;
+    uint64_t coalesced;
+    uint64_t misses;
+    size_t   entries;
+    size_t   bytes;
+    size_t   maxBytes;
+    size_t   evictions;
+  };
+
+  // Finished renders keyed by normalized source and render options.
+  // Concurrent requests for the same key share a single render.
+  class ResultCache : public NonCopyable {
+  public:
+    ResultCache(size_t maxBytes);
+
+    static ResultCache* instance();
+
+    // Expects a program that has already been through Renderer::fixCode.
+    static Hash128 key(const ShaderProgram& program, const RendererOptions& options);
+
+    EncodedImage find(const Hash128& key);
+
+    // Returns the cached image if there is one. Otherwise joins a render already
+    // running for this key, or runs render itself and caches the result.
+    // Failures are shared with everyone who joined but never cached.
+    Task<EncodedImage> findOrRender(Hash128 key, std::function<Task<std::vector<uint8_t>>()> render);
+
+    ResultCacheStats stats();
+
+  private:
+
+    struct InFlight {
+      bool                                 done = false;
+      EncodedImage                         image;
+      std::exception_ptr                   error;
+      std::vector<std::coroutine_handle<>> waiters;
+    };
+
+    struct JoinAwaiter {
+      ResultCache* cache;
+      InFlight*    flight;
+
+      bool await_ready() const noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> awaiting);
+
+      void await_resume() const noexcept { }
+    };
+
+    std::mutex                                                            m_mutex;
+    LruCache<Hash128, EncodedImage, Hash128Hasher>                        m_memory;
+    std::unordered_map<Hash128, std::shared_ptr<InFlight>, Hash128Hasher> m_inFlight;
+
+    std::atomic<uint64_t> m_hits      = 0;
+    std::atomic<uint64_t> m_coalesced = 0;
+    std::atomic<uint64_t> m_misses    = 0;
+  };
+
+}
\ No newline at end of file
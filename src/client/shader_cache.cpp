@@ -0,0 +1,238 @@
+#include "shader_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <sstream>
+
+namespace shadey {
+
+  namespace {
+    static constexpr size_t           g_defaultCacheBytes    = 32 * 1024 * 1024;
+    static constexpr std::string_view g_defaultDiskDirectory = "shader_cache";
+    static constexpr size_t           g_defaultDiskBytes     = 256 * 1024 * 1024;
+
+    static constexpr uint32_t g_diskMagic   = 0x43565053; // 'SPVC'
+    static constexpr uint32_t g_diskVersion = 1;
+
+    struct DiskHeader {
+      uint32_t magic;
+      uint32_t version;
+      Hash128  key;
+      uint64_t size;
+    };
+  }
+
+  ShaderCache::ShaderCache(size_t maxBytes, std::string diskDirectory, size_t maxDiskBytes)
+    : m_memory       (maxBytes)
+    , m_diskDirectory(std::move(diskDirectory))
+    , m_maxDiskBytes (maxDiskBytes) { }
+
+
+  ShaderCache* ShaderCache::instance() {
+    static std::unique_ptr<ShaderCache> s_instance =
+      std::make_unique<ShaderCache>(g_defaultCacheBytes, std::string(g_defaultDiskDirectory), g_defaultDiskBytes);
+
+    return s_instance.get();
+  }
+
+
+  bool ShaderCache::find(const Hash128& key, std::vector<uint8_t>& spv) {
+    std::filesystem::path path;
+    {
+      std::lock_guard lock(m_mutex);
+
+      if (auto entry = m_memory.find(key)) {
+        spv = *entry;
+        m_memoryHits++;
+        return true;
+      }
+
+      path = diskPath(key);
+    }
+
+    if (!path.empty() && readDisk(path, key, spv)) {
+      std::lock_guard lock(m_mutex);
+      m_memory.insert(key, spv, spv.size());
+      m_diskHits++;
+      return true;
+    }
+
+    m_misses++;
+    return false;
+  }
+
+
+  void ShaderCache::insert(const Hash128& key, const std::vector<uint8_t>& spv) {
+    std::filesystem::path path;
+    {
+      std::lock_guard lock(m_mutex);
+      m_memory.insert(key, spv, spv.size());
+      path = diskPath(key);
+    }
+
+    if (!path.empty())
+      writeDisk(path, key, spv);
+  }
+
+
+  void ShaderCache::setDiskDirectory(std::string directory) {
+    std::scoped_lock lock(m_mutex, m_diskMutex);
+    m_diskDirectory = std::move(directory);
+    m_diskBytes     = 0;
+    m_diskScanned   = false;
+  }
+
+
+  ShaderCacheStats ShaderCache::stats() {
+    std::scoped_lock lock(m_mutex, m_diskMutex);
+
+    return ShaderCacheStats {
+      .memoryHits    = m_memoryHits,
+      .diskHits      = m_diskHits,
+      .misses        = m_misses,
+      .entries       = m_memory.size(),
+      .bytes         = m_memory.cost(),
+      .maxBytes      = m_memory.maxCost(),
+      .evictions     = m_memory.evictions(),
+      .diskBytes     = m_diskBytes,
+      .maxDiskBytes  = m_maxDiskBytes,
+      .diskEvictions = m_diskEvictions
+    };
+  }
+
+
+  std::filesystem::path ShaderCache::diskPath(const Hash128& key) {
+    if (m_diskDirectory.empty())
+      return { };
+
+    return std::filesystem::path(m_diskDirectory) / (key.toString() + ".spv");
+  }
+
+
+  bool ShaderCache::readDisk(const std::filesystem::path& path, const Hash128& key, std::vector<uint8_t>& spv) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+
+    DiskHeader header = { };
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+      return false;
+
+    // Anything unexpected is treated as a miss and gets overwritten later.
+    if (header.magic != g_diskMagic || header.version != g_diskVersion || header.key != key)
+      return false;
+
+    if (header.size == 0 || header.size % sizeof(uint32_t) != 0 || header.size > g_defaultCacheBytes)
+      return false;
+
+    std::vector<uint8_t> data(header.size);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size()))
+      return false;
+
+    // Eviction goes by modification time, so a hit keeps the file around.
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+    spv = std::move(data);
+    return true;
+  }
+
+
+  void ShaderCache::writeDisk(const std::filesystem::path& path, const Hash128& key, const std::vector<uint8_t>& spv) {
+    // The disk tier is best effort, failing to write just means a miss later.
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+      return;
+
+    // Write somewhere unique and rename over so readers never see half a file.
+    std::stringstream tempName;
+    tempName << path.filename().string() << ".tmp." << std::this_thread::get_id();
+    const auto tempPath = path.parent_path() / tempName.str();
+
+    {
+      std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+      if (!file)
+        return;
+
+      const DiskHeader header = {
+        .magic   = g_diskMagic,
+        .version = g_diskVersion,
+        .key     = key,
+        .size    = spv.size()
+      };
+
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      file.write(reinterpret_cast<const char*>(spv.data()), spv.size());
+
+      if (!file) {
+        file.close();
+        std::filesystem::remove(tempPath, ec);
+        return;
+      }
+    }
+
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+      std::filesystem::remove(tempPath, ec);
+      return;
+    }
+
+    std::lock_guard lock(m_diskMutex);
+
+    m_diskBytes += sizeof(DiskHeader) + spv.size();
+
+    // The first write also counts whatever an earlier run left behind, it's the same walk as evicting.
+    if (!m_diskScanned || m_diskBytes > m_maxDiskBytes) {
+      evictDisk(path.parent_path());
+      m_diskScanned = true;
+    }
+  }
+
+
+  void ShaderCache::evictDisk(const std::filesystem::path& directory) {
+    struct DiskFile {
+      std::filesystem::path           path;
+      std::filesystem::file_time_type time;
+      size_t                          size;
+    };
+
+    std::vector<DiskFile> files;
+    size_t                total = 0;
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+      if (entry.path().extension() != ".spv")
+        continue;
+
+      std::error_code entryEc;
+      const auto time = entry.last_write_time(entryEc);
+      const auto size = entry.file_size(entryEc);
+      if (entryEc)
+        continue;
+
+      files.push_back({ entry.path(), time, size_t(size) });
+      total += size_t(size);
+    }
+
+    // Down to three quarters, so the next few writes don't each walk the directory again.
+    if (total > m_maxDiskBytes) {
+      std::sort(files.begin(), files.end(), [](const DiskFile& a, const DiskFile& b) { return a.time < b.time; });
+
+      for (const auto& file : files) {
+        if (total <= m_maxDiskBytes / 4 * 3)
+          break;
+
+        if (std::filesystem::remove(file.path, ec)) {
+          total -= file.size;
+          m_diskEvictions++;
+        }
+      }
+    }
+
+    m_diskBytes = total;
+  }
+
+}
\ No newline at end of file
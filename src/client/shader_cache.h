@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "hash_helpers.h"
+#include "lru_cache.h"
+#include "non_copyable.h"
+
+namespace shadey {
+
+  struct ShaderCacheStats {
+    uint64_t memoryHits;
+    uint64_t diskHits;
+    uint64_t misses;
+    size_t   entries;
+    size_t   bytes;
+    size_t   maxBytes;
+    size_t   evictions;
+    size_t   diskBytes;
+    size_t   maxDiskBytes;
+    uint64_t diskEvictions;
+  };
+
+  // Content-addressed SPIR-V cache.
+  // Lookups hit an in-memory LRU first, then the optional on-disk tier.
+  // The disk tier is capped too, dropping the least recently used files once it's full.
+  class ShaderCache : public NonCopyable {
+  public:
+    ShaderCache(size_t maxBytes, std::string diskDirectory, size_t maxDiskBytes);
+
+    static ShaderCache* instance();
+
+    bool find(const Hash128& key, std::vector<uint8_t>& spv);
+
+    void insert(const Hash128& key, const std::vector<uint8_t>& spv);
+
+    // An empty directory disables the disk tier.
+    void setDiskDirectory(std::string directory);
+
+    ShaderCacheStats stats();
+
+  private:
+
+    bool readDisk(const std::filesystem::path& path, const Hash128& key, std::vector<uint8_t>& spv) const;
+
+    void writeDisk(const std::filesystem::path& path, const Hash128& key, const std::vector<uint8_t>& spv);
+
+    // Must hold m_diskMutex. Deletes the oldest files until the directory is back under m_maxDiskBytes.
+    void evictDisk(const std::filesystem::path& directory);
+
+    std::filesystem::path diskPath(const Hash128& key);
+
+    std::mutex                                               m_mutex;
+    LruCache<Hash128, std::vector<uint8_t>, Hash128Hasher> m_memory;
+    std::string                                              m_diskDirectory;
+
+    // What's in the disk directory, counted on first write and kept up to date after.
+    std::mutex m_diskMutex;
+    size_t     m_maxDiskBytes;
+    size_t     m_diskBytes     = 0;
+    bool       m_diskScanned   = false;
+    uint64_t   m_diskEvictions = 0;
+
+    std::atomic<uint64_t> m_memoryHits = 0;
+    std::atomic<uint64_t> m_diskHits   = 0;
+    std::atomic<uint64_t> m_misses     = 0;
+  };
+
+}
\ No newline at end of file
@@ -5,9 +5,26 @@
 #include <cstring>
 
 #include <glslang/Include/glslang_c_interface.h>
+#if __has_include(<glslang/build_info.h>)
+#include <glslang/build_info.h>
+#endif
+
+#include "hash_helpers.h"
+#include "shader_cache.h"
 
 namespace shadey {
 
+  static constexpr glslang_target_client_version_t   g_clientVersion = GLSLANG_TARGET_VULKAN_1_1;
+  static constexpr glslang_target_language_version_t g_spirvVersion  = GLSLANG_TARGET_SPV_1_3;
+
+  // Part of every cache key, so upgrading glslang doesn't keep serving SPIR-V from the old one.
+#ifdef GLSLANG_VERSION_MAJOR
+  static constexpr uint32_t g_compilerVersion = GLSLANG_VERSION_MAJOR * 10000 + GLSLANG_VERSION_MINOR * 100 + GLSLANG_VERSION_PATCH;
+#else
+  // Older glslang has no build_info.h, bump this by hand when updating it.
+  static constexpr uint32_t g_compilerVersion = 1;
+#endif
+
   constexpr glslang_resource_t DefaultResource = {
   /* .MaxLights = */ 32,
   /* .MaxClipPlanes = */ 6,
@@ -115,16 +132,24 @@ namespace shadey {
       /* .generalConstantMatrixVectorIndexing = */ 1,
   }};
 
-  std::vector<uint8_t> compileShader(bool hlsl, bool fragment, const std::string& glsl) {
+  static glslang_stage_t glslangStage(ShaderStage stage) {
+    switch (stage) {
+      case ShaderStage_Fragment: return GLSLANG_STAGE_FRAGMENT;
+      case ShaderStage_Compute:  return GLSLANG_STAGE_COMPUTE;
+      default:                   return GLSLANG_STAGE_VERTEX;
+    }
+  }
+
+  std::vector<uint8_t> compileShaderUncached(bool hlsl, ShaderStage stage, const std::string& glsl) {
 	glslang_resource_t resource = DefaultResource;
 
     const glslang_input_t input = {
 	  .language = hlsl ? GLSLANG_SOURCE_HLSL : GLSLANG_SOURCE_GLSL,
-	  .stage = fragment ? GLSLANG_STAGE_FRAGMENT : GLSLANG_STAGE_VERTEX,
+	  .stage = glslangStage(stage),
 	  .client = GLSLANG_CLIENT_VULKAN,
-	  .client_version = GLSLANG_TARGET_VULKAN_1_1,
+	  .client_version = g_clientVersion,
 	  .target_language = GLSLANG_TARGET_SPV,
-	  .target_language_version = GLSLANG_TARGET_SPV_1_3,
+	  .target_language_version = g_spirvVersion,
 	  .code = glsl.c_str(),
 	  .default_version = 100,
 	  .default_profile = GLSLANG_NO_PROFILE,
@@ -173,4 +198,64 @@ namespace shadey {
     return bytes;
   }
 
+
+  std::vector<uint8_t> compileShader(bool hlsl, ShaderStage stage, const std::string& glsl) {
+    const Hash128 key = Hasher128()
+      .updateValue(hlsl ? GLSLANG_SOURCE_HLSL : GLSLANG_SOURCE_GLSL)
+      .updateValue(glslangStage(stage))
+      .updateValue(g_clientVersion)
+      .updateValue(g_spirvVersion)
+      .updateValue(g_compilerVersion)
+      .update(glsl)
+      .finish();
+
+    auto cache = ShaderCache::instance();
+
+    std::vector<uint8_t> spv;
+    if (cache->find(key, spv))
+      return spv;
+
+    // Failures throw out of here, so only good SPIR-V ever gets cached.
+    spv = compileShaderUncached(hlsl, stage, glsl);
+    cache->insert(key, spv);
+
+    return spv;
+  }
+
+
+  bool spirvLocalSize(const std::vector<uint8_t>& spv, uint32_t localSize[3]) {
+    static constexpr uint32_t OpExecutionMode        = 16;
+    static constexpr uint32_t ExecutionModeLocalSize = 17;
+    // Magic, version, generator, bound and schema come before the first instruction.
+    static constexpr size_t   HeaderWords            = 5;
+
+    const size_t wordCount = spv.size() / sizeof(uint32_t);
+
+    auto word = [&](size_t index) {
+      uint32_t value;
+      std::memcpy(&value, spv.data() + index * sizeof(uint32_t), sizeof(value));
+      return value;
+    };
+
+    for (size_t i = HeaderWords; i < wordCount; ) {
+      const uint32_t opcode = word(i) & 0xffff;
+      const uint32_t length = word(i) >> 16;
+
+      if (length == 0 || i + length > wordCount)
+        return false;
+
+      // OpExecutionMode <entry point> LocalSize x y z
+      if (opcode == OpExecutionMode && length == 6 && word(i + 2) == ExecutionModeLocalSize) {
+        localSize[0] = word(i + 3);
+        localSize[1] = word(i + 4);
+        localSize[2] = word(i + 5);
+        return true;
+      }
+
+      i += length;
+    }
+
+    return false;
+  }
+
 }
\ No newline at end of file
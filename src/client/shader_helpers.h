@@ -1,10 +1,33 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
 namespace shadey {
 
-  std::vector<uint8_t> compileShader(bool hlsl, bool fragment, const std::string& glsl);
+  enum ShaderStage {
+    ShaderStage_Vertex,
+    ShaderStage_Fragment,
+    ShaderStage_Compute,
+  };
+
+  // The stages one render compiles. Both share a language.
+  struct ShaderProgram {
+    bool        hlsl = false;
+    // The compute shader instead for `type = compute` renders.
+    std::string fragment;
+    // Empty uses the built-in vertex shader for the vertex type directive.
+    std::string vertex;
+  };
+
+  std::vector<uint8_t> compileShader(bool hlsl, ShaderStage stage, const std::string& glsl);
+
+  // Skips the ShaderCache, for measuring the compiler itself.
+  std::vector<uint8_t> compileShaderUncached(bool hlsl, ShaderStage stage, const std::string& glsl);
+
+  // The workgroup size a compiled compute shader declares, from its LocalSize execution mode.
+  // False if it has none, e.g. when it's only given through specialization constants.
+  bool spirvLocalSize(const std::vector<uint8_t>& spv, uint32_t localSize[3]);
 
 }
\ No newline at end of file
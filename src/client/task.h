@@ -0,0 +1,147 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace shadey {
+
+  template <typename T = void>
+  class Task;
+
+  namespace detail {
+
+    struct TaskPromiseBase {
+      std::coroutine_handle<> continuation;
+      std::exception_ptr      error;
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+
+      // Hand straight back to whoever awaited us, without growing the stack.
+      struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+          auto continuation = handle.promise().continuation;
+          return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept { }
+      };
+
+      FinalAwaiter final_suspend() noexcept { return {}; }
+
+      void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase {
+      std::optional<T> value;
+
+      Task<T> get_return_object();
+
+      void return_value(T result) { value.emplace(std::move(result)); }
+
+      T result() {
+        if (error)
+          std::rethrow_exception(error);
+
+        return std::move(*value);
+      }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase {
+      Task<void> get_return_object();
+
+      void return_void() { }
+
+      void result() {
+        if (error)
+          std::rethrow_exception(error);
+      }
+    };
+
+    // Fire and forget wrapper, frees itself once the task it runs is done.
+    struct DetachedTask {
+      struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() { }
+
+        void unhandled_exception() { std::terminate(); }
+      };
+    };
+
+  }
+
+  // Lazily started coroutine, runs when awaited and resumes the awaiter when done.
+  template <typename T>
+  class [[nodiscard]] Task {
+  public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task(Task&& other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr)) { }
+
+    Task& operator = (Task&& other) noexcept {
+      if (this != &other) {
+        if (m_handle)
+          m_handle.destroy();
+
+        m_handle = std::exchange(other.m_handle, nullptr);
+      }
+      return *this;
+    }
+
+    ~Task() {
+      if (m_handle)
+        m_handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+      m_handle.promise().continuation = awaiting;
+      return m_handle;
+    }
+
+    T await_resume() { return m_handle.promise().result(); }
+
+  private:
+    friend promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle) { }
+
+    std::coroutine_handle<promise_type> m_handle;
+  };
+
+  namespace detail {
+
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+      return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+      return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+  }
+
+  // Starts a task on the current thread and lets it run to completion on its own.
+  // The task must handle its own exceptions.
+  inline void spawn(Task<> task) {
+    [](Task<> task) -> detail::DetachedTask {
+      co_await task;
+    }(std::move(task));
+  }
+
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace shadey {
+
+  ThreadPool::ThreadPool(uint32_t threadCount) {
+    threadCount = std::max(threadCount, 1u);
+
+    for (uint32_t i = 0; i < threadCount; i++)
+      m_threads.emplace_back([this] { workerLoop(); });
+  }
+
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard lock(m_mutex);
+      m_stopping = true;
+    }
+    m_cond.notify_all();
+
+    for (auto& thread : m_threads)
+      thread.join();
+  }
+
+
+  ThreadPool* ThreadPool::instance() {
+    static std::unique_ptr<ThreadPool> s_instance =
+      std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+
+    return s_instance.get();
+  }
+
+
+  void ThreadPool::enqueue(std::function<void()> task) {
+    {
+      std::lock_guard lock(m_mutex);
+      m_tasks.push_back(std::move(task));
+    }
+    m_cond.notify_one();
+  }
+
+
+  void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func) {
+    if (count == 0)
+      return;
+
+    // Helpers may only get to run after we've returned, so everything
+    // they touch lives in shared state rather than on our stack.
+    struct State {
+      std::function<void(size_t)> func;
+      size_t                      count;
+      std::atomic<size_t>         next     = 0;
+      size_t                      finished = 0;
+      std::exception_ptr          error;
+      std::mutex                  mutex;
+      std::condition_variable     cond;
+
+      void run() {
+        for (size_t i = next++; i < count; i = next++) {
+          std::exception_ptr caught;
+          try {
+            func(i);
+          }
+          catch (...) {
+            caught = std::current_exception();
+          }
+
+          std::lock_guard lock(mutex);
+          if (caught && !error)
+            error = caught;
+
+          if (++finished == count)
+            cond.notify_all();
+        }
+      }
+    };
+
+    auto state = std::make_shared<State>();
+    state->func  = func;
+    state->count = count;
+
+    const size_t helpers = std::min<size_t>(count - 1, m_threads.size());
+    for (size_t i = 0; i < helpers; i++)
+      enqueue([state] { state->run(); });
+
+    state->run();
+
+    std::unique_lock lock(state->mutex);
+    state->cond.wait(lock, [&] { return state->finished == state->count; });
+
+    if (state->error)
+      std::rethrow_exception(state->error);
+  }
+
+
+  void ThreadPool::workerLoop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+
+        if (m_stopping && m_tasks.empty())
+          return;
+
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+      }
+
+      task();
+    }
+  }
+
+}
\ No newline at end of file
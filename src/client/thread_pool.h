@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  class ThreadPool : public NonCopyable {
+  public:
+    ThreadPool(uint32_t threadCount);
+
+    ~ThreadPool();
+
+    // Shared pool for CPU heavy work, one thread per core.
+    static ThreadPool* instance();
+
+    void enqueue(std::function<void()> task);
+
+    // Runs func(0..count-1) across the pool and returns once all are done.
+    // The calling thread works too, so this is safe to call from inside the pool.
+    void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    uint32_t threadCount() const { return uint32_t(m_threads.size()); }
+
+  private:
+
+    void workerLoop();
+
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cond;
+    std::deque<std::function<void()>> m_tasks;
+    bool                              m_stopping = false;
+
+    std::vector<std::thread>          m_threads;
+  };
+
+}
\ No newline at end of file
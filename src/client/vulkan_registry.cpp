@@ -0,0 +1,867 @@
+#include "vulkan_registry.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tinyxml2.h"
+
+namespace shadey {
+
+  // vk.xml.bin layout, native endian:
+  //
+  //   Header
+  //   uint32_t      buckets[bucketCount]    first type in each hash chain
+  //   TypeRecord    types[typeCount]
+  //   MemberRecord  members[memberCount]
+  //   NameRecord    names[nameCount]        types and commands, sorted ignoring case
+  //   TrigramRecord trigrams[trigramCount]  sorted by key
+  //   uint32_t      postings[postingCount]  names containing each trigram
+  //   char          strings[stringBytes]    NUL terminated, offset 0 is ""
+  //
+  // Every string field is an offset into the string table, 0 when absent.
+
+  struct VulkanRegistry::Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t bucketCount;
+    uint32_t typeCount;
+    uint32_t memberCount;
+    uint32_t nameCount;
+    uint32_t trigramCount;
+    uint32_t postingCount;
+    uint32_t stringBytes;
+    // The vk.xml this was built from, a mismatch means it's stale.
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+  };
+
+  struct VulkanRegistry::TypeRecord {
+    uint32_t name;
+    // Differs from name for aliases, which show the type they alias.
+    uint32_t structName;
+    uint32_t firstMember;
+    uint32_t memberCount;
+    uint32_t nextInBucket;
+  };
+
+  struct VulkanRegistry::MemberRecord {
+    uint32_t type;
+    uint32_t name;
+    uint32_t comment;
+    uint32_t values;
+    uint32_t optional;
+    uint32_t len;
+    uint32_t flags;
+  };
+
+  struct VulkanRegistry::NameRecord {
+    uint32_t name;
+    uint32_t flags;
+  };
+
+  struct VulkanRegistry::TrigramRecord {
+    uint32_t key;
+    uint32_t firstPosting;
+    uint32_t postingCount;
+  };
+
+  namespace {
+    static constexpr const char* g_registryPath = "vk.xml";
+
+    static constexpr const char* g_manPageUrl = "https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/";
+
+    static constexpr char     g_binaryMagic[8] = { 'S', 'H', 'D', 'Y', 'V', 'K', 'R', 'G' };
+    static constexpr uint32_t g_binaryVersion  = 2;
+    static constexpr uint32_t g_noType         = UINT32_MAX;
+
+    static constexpr uint32_t g_memberConst   = 1u << 0;
+    static constexpr uint32_t g_memberPointer = 1u << 1;
+
+    static constexpr uint32_t g_nameCommand = 1u << 0;
+
+    // Marks the start and end of a name, so "$vk" only matches names starting with vk.
+    static constexpr char g_trigramPadding = '$';
+
+    // Candidates with the most trigrams in common that get an exact edit distance.
+    static constexpr size_t g_minFuzzyCandidates = 32;
+
+    // Alias chains in vk.xml are short, this only guards against a broken file.
+    static constexpr uint32_t g_maxAliasDepth = 8;
+
+    // Stable across builds, unlike std::hash, since the table is stored on disk.
+    static uint32_t hashName(std::string_view name) {
+      uint32_t hash = 2166136261u;
+      for (char c : name) {
+        hash ^= uint8_t(c);
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    static bool StringContains(const char* s1, const char* s2) {
+      if (s1 == s2)
+        return true;
+
+      if (s1 == nullptr || s2 == nullptr)
+        return false;
+
+      return strstr(s1, s2);
+    }
+
+    static const char* PreviousText(const tinyxml2::XMLNode* node) {
+      if (node == nullptr)
+        return nullptr;
+
+      node = node->PreviousSibling();
+
+      if (node == nullptr)
+        return nullptr;
+
+      auto text = node->ToText();
+
+      return text == nullptr
+        ? nullptr
+        : text->Value();
+    }
+
+    static char lowerAscii(char c) {
+      return c >= 'A' && c <= 'Z'
+        ? char(c - 'A' + 'a')
+        : c;
+    }
+
+    // Vulkan names are ASCII, so this is all the case folding needed.
+    static bool lessIgnoringCase(std::string_view a, std::string_view b) {
+      const size_t length = std::min(a.length(), b.length());
+      for (size_t i = 0; i < length; i++) {
+        const char x = lowerAscii(a[i]);
+        const char y = lowerAscii(b[i]);
+        if (x != y)
+          return x < y;
+      }
+
+      if (a.length() != b.length())
+        return a.length() < b.length();
+
+      // Keeps the order total for names that only differ in case.
+      return a < b;
+    }
+
+    static bool startsWithIgnoringCase(std::string_view str, std::string_view prefix) {
+      if (str.length() < prefix.length())
+        return false;
+
+      for (size_t i = 0; i < prefix.length(); i++) {
+        if (lowerAscii(str[i]) != lowerAscii(prefix[i]))
+          return false;
+      }
+
+      return true;
+    }
+
+    // Matches a pattern where * stands for any run of characters, ignoring case.
+    static bool globMatch(std::string_view str, std::string_view pattern) {
+      size_t s = 0, p = 0;
+      size_t starP = std::string_view::npos, starS = 0;
+
+      while (s < str.length()) {
+        if (p < pattern.length() && pattern[p] == '*') {
+          starP = p++;
+          starS = s;
+        }
+        else if (p < pattern.length() && lowerAscii(pattern[p]) == lowerAscii(str[s])) {
+          p++;
+          s++;
+        }
+        else if (starP != std::string_view::npos) {
+          p = starP + 1;
+          s = ++starS;
+        }
+        else {
+          return false;
+        }
+      }
+
+      while (p < pattern.length() && pattern[p] == '*')
+        p++;
+
+      return p == pattern.length();
+    }
+
+    // Levenshtein distance ignoring case, or limit + 1 as soon as it's clearly over the limit.
+    // Rows are passed in so they're only allocated once per query.
+    static uint32_t editDistance(std::string_view a, std::string_view b, uint32_t limit, std::vector<uint32_t>& previous, std::vector<uint32_t>& current) {
+      const size_t lengthDifference = a.length() > b.length() ? a.length() - b.length() : b.length() - a.length();
+      if (lengthDifference > limit)
+        return limit + 1;
+
+      previous.resize(b.length() + 1);
+      current.resize(b.length() + 1);
+
+      for (size_t j = 0; j <= b.length(); j++)
+        previous[j] = uint32_t(j);
+
+      for (size_t i = 1; i <= a.length(); i++) {
+        const char x = lowerAscii(a[i - 1]);
+
+        current[0] = uint32_t(i);
+        uint32_t rowMin = current[0];
+        for (size_t j = 1; j <= b.length(); j++) {
+          const uint32_t substitution = previous[j - 1] + (x == lowerAscii(b[j - 1]) ? 0 : 1);
+          current[j] = std::min(std::min(previous[j], current[j - 1]) + 1, substitution);
+          rowMin     = std::min(rowMin, current[j]);
+        }
+
+        // Distances never shrink going down, so no later row can get back under the limit.
+        if (rowMin > limit)
+          return limit + 1;
+
+        std::swap(previous, current);
+      }
+
+      return previous[b.length()];
+    }
+
+    // Lowercased trigrams of str, padded at both ends when it's a whole name rather than a fragment.
+    static void collectTrigrams(std::string_view str, bool padded, std::vector<uint32_t>& trigrams) {
+      const size_t length = str.length() + (padded ? 2 : 0);
+      auto at = [&](size_t i) {
+        if (padded)
+          return i == 0 || i == length - 1 ? g_trigramPadding : lowerAscii(str[i - 1]);
+        return lowerAscii(str[i]);
+      };
+
+      trigrams.clear();
+      for (size_t i = 0; i + 3 <= length; i++)
+        trigrams.push_back(uint32_t(uint8_t(at(i))) << 16 | uint32_t(uint8_t(at(i + 1))) << 8 | uint32_t(uint8_t(at(i + 2))));
+
+      std::sort(trigrams.begin(), trigrams.end());
+      trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    }
+
+    class StringTable {
+    public:
+      StringTable() { m_data.push_back('\0'); }
+
+      uint32_t add(const char* str) {
+        if (str == nullptr || *str == '\0')
+          return 0;
+
+        auto [entry, inserted] = m_offsets.try_emplace(str, uint32_t(m_data.size()));
+        if (inserted)
+          m_data.insert(m_data.end(), str, str + strlen(str) + 1);
+
+        return entry->second;
+      }
+
+      const std::vector<char>& data() const { return m_data; }
+
+    private:
+      std::vector<char>                         m_data;
+      std::unordered_map<std::string, uint32_t> m_offsets;
+    };
+
+    static void appendBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+      const auto* bytes = static_cast<const uint8_t*>(data);
+      out.insert(out.end(), bytes, bytes + size);
+    }
+  }
+
+
+  std::vector<uint8_t> VulkanRegistry::build(const std::string& path, uint64_t sourceSize, int64_t sourceTime) {
+    tinyxml2::XMLDocument doc;
+    if (doc.LoadFile(path.c_str()) != tinyxml2::XML_SUCCESS)
+      return { };
+
+    auto registry = doc.FirstChildElement("registry");
+    auto types    = registry ? registry->FirstChildElement("types") : nullptr;
+    if (!types)
+      return { };
+
+    // The first definition of a name wins, same as a linear search would find.
+    std::vector<const tinyxml2::XMLElement*>                           elements;
+    std::unordered_map<std::string_view, const tinyxml2::XMLElement*> byName;
+    for (const tinyxml2::XMLElement* type = types->FirstChildElement("type"); type != nullptr; type = type->NextSiblingElement("type")) {
+      const char* category = type->Attribute("category");
+      const char* name     = type->Attribute("name");
+
+      if (category != nullptr && name != nullptr && byName.emplace(name, type).second)
+        elements.push_back(type);
+    }
+
+    struct MemberRange {
+      uint32_t first = 0;
+      uint32_t count = 0;
+    };
+
+    StringTable                                                  strings;
+    std::vector<TypeRecord>                                      typeRecords;
+    std::vector<MemberRecord>                                    memberRecords;
+    std::unordered_map<const tinyxml2::XMLElement*, MemberRange> memberRanges;
+
+    for (const auto* type : elements) {
+      const tinyxml2::XMLElement* resolved = type;
+      for (uint32_t depth = 0; depth < g_maxAliasDepth; depth++) {
+        const char* alias = resolved->Attribute("alias");
+        if (alias == nullptr)
+          break;
+
+        auto target = byName.find(alias);
+        if (target == byName.end())
+          break;
+
+        resolved = target->second;
+      }
+
+      // Aliases share the members of the type they resolve to.
+      auto [range, inserted] = memberRanges.try_emplace(resolved, MemberRange{ .first = uint32_t(memberRecords.size()) });
+      if (inserted) {
+        for (auto member = resolved->FirstChildElement("member"); member != nullptr; member = member->NextSiblingElement("member")) {
+          auto memberType = member->FirstChildElement("type");
+          auto memberName = member->FirstChildElement("name");
+
+          if (memberType == nullptr || memberName == nullptr)
+            continue;
+
+          auto comment = member->FirstChildElement("comment");
+
+          uint32_t flags = 0;
+          if (StringContains(PreviousText(memberType), "const")) flags |= g_memberConst;
+          if (StringContains(PreviousText(memberName), "*"))     flags |= g_memberPointer;
+
+          memberRecords.push_back({
+            .type     = strings.add(memberType->GetText()),
+            .name     = strings.add(memberName->GetText()),
+            .comment  = strings.add(comment ? comment->GetText() : nullptr),
+            .values   = strings.add(member->Attribute("values")),
+            .optional = strings.add(member->Attribute("optional")),
+            .len      = strings.add(member->Attribute("len")),
+            .flags    = flags,
+          });
+        }
+
+        range->second.count = uint32_t(memberRecords.size()) - range->second.first;
+      }
+
+      typeRecords.push_back({
+        .name         = strings.add(type->Attribute("name")),
+        .structName   = strings.add(resolved->Attribute("name")),
+        .firstMember  = range->second.first,
+        .memberCount  = range->second.count,
+        .nextInBucket = g_noType,
+      });
+    }
+
+    // Every name a search can turn up, types first so they win over a command with the same name.
+    std::vector<NameRecord>              nameRecords;
+    std::unordered_set<std::string_view> seenNames;
+    for (const auto* type : elements) {
+      nameRecords.push_back({ .name = strings.add(type->Attribute("name")), .flags = 0 });
+      seenNames.insert(type->Attribute("name"));
+    }
+
+    auto commands = registry->FirstChildElement("commands");
+    for (const tinyxml2::XMLElement* command = commands ? commands->FirstChildElement("command") : nullptr; command != nullptr; command = command->NextSiblingElement("command")) {
+      // Aliases only carry a name attribute, everything else names itself in its prototype.
+      const char* name = command->Attribute("name");
+      if (name == nullptr) {
+        auto proto     = command->FirstChildElement("proto");
+        auto protoName = proto ? proto->FirstChildElement("name") : nullptr;
+        name = protoName ? protoName->GetText() : nullptr;
+      }
+
+      if (name != nullptr && seenNames.insert(name).second)
+        nameRecords.push_back({ .name = strings.add(name), .flags = g_nameCommand });
+    }
+
+    std::sort(nameRecords.begin(), nameRecords.end(), [&](const NameRecord& a, const NameRecord& b) {
+      return lessIgnoringCase(&strings.data()[a.name], &strings.data()[b.name]);
+    });
+
+    std::vector<std::pair<uint32_t, uint32_t>> nameTrigrams;
+    std::vector<uint32_t>                      trigrams;
+    for (uint32_t i = 0; i < nameRecords.size(); i++) {
+      collectTrigrams(&strings.data()[nameRecords[i].name], true, trigrams);
+      for (uint32_t trigram : trigrams)
+        nameTrigrams.emplace_back(trigram, i);
+    }
+    std::sort(nameTrigrams.begin(), nameTrigrams.end());
+
+    std::vector<TrigramRecord> trigramRecords;
+    std::vector<uint32_t>      postings;
+    for (const auto& [key, nameIndex] : nameTrigrams) {
+      if (trigramRecords.empty() || trigramRecords.back().key != key)
+        trigramRecords.push_back({ .key = key, .firstPosting = uint32_t(postings.size()), .postingCount = 0 });
+
+      trigramRecords.back().postingCount++;
+      postings.push_back(nameIndex);
+    }
+
+    // A load factor around 0.5 keeps chains to a probe or two.
+    const uint32_t bucketCount = std::max<uint32_t>(1, std::bit_ceil(uint32_t(typeRecords.size() * 2)));
+    std::vector<uint32_t> buckets(bucketCount, g_noType);
+
+    for (uint32_t i = 0; i < typeRecords.size(); i++) {
+      const char* name = &strings.data()[typeRecords[i].name];
+      uint32_t&   head = buckets[hashName(name) & (bucketCount - 1)];
+
+      typeRecords[i].nextInBucket = head;
+      head = i;
+    }
+
+    Header header = {
+      .version      = g_binaryVersion,
+      .bucketCount  = bucketCount,
+      .typeCount    = uint32_t(typeRecords.size()),
+      .memberCount  = uint32_t(memberRecords.size()),
+      .nameCount    = uint32_t(nameRecords.size()),
+      .trigramCount = uint32_t(trigramRecords.size()),
+      .postingCount = uint32_t(postings.size()),
+      .stringBytes  = uint32_t(strings.data().size()),
+      .sourceSize   = sourceSize,
+      .sourceTime   = sourceTime,
+    };
+    std::memcpy(header.magic, g_binaryMagic, sizeof(g_binaryMagic));
+
+    std::vector<uint8_t> out;
+    appendBytes(out, &header, sizeof(header));
+    appendBytes(out, buckets.data(),        buckets.size()        * sizeof(uint32_t));
+    appendBytes(out, typeRecords.data(),    typeRecords.size()    * sizeof(TypeRecord));
+    appendBytes(out, memberRecords.data(),  memberRecords.size()  * sizeof(MemberRecord));
+    appendBytes(out, nameRecords.data(),    nameRecords.size()    * sizeof(NameRecord));
+    appendBytes(out, trigramRecords.data(), trigramRecords.size() * sizeof(TrigramRecord));
+    appendBytes(out, postings.data(),       postings.size()       * sizeof(uint32_t));
+    appendBytes(out, strings.data().data(), strings.data().size());
+    return out;
+  }
+
+
+  VulkanRegistry::VulkanRegistry(const std::string& path) {
+    const std::string binaryPath = path + ".bin";
+
+    std::error_code ec;
+    const bool     haveSource = std::filesystem::is_regular_file(path, ec);
+    const uint64_t sourceSize = haveSource ? std::filesystem::file_size(path, ec) : 0;
+    const int64_t  sourceTime = haveSource ? int64_t(std::filesystem::last_write_time(path, ec).time_since_epoch().count()) : 0;
+
+    // Without vk.xml around, whatever binary we have is the best there is.
+    if (!haveSource) {
+      if (!map(binaryPath, 0, 0))
+        std::cout << "Failed to load " << path << ", Vulkan type lookups are disabled" << std::endl;
+      return;
+    }
+
+    if (map(binaryPath, sourceSize, sourceTime))
+      return;
+
+    const std::vector<uint8_t> binary = build(path, sourceSize, sourceTime);
+    if (binary.empty()) {
+      std::cout << "Failed to parse " << path << ", Vulkan type lookups are disabled" << std::endl;
+      return;
+    }
+
+    // Written aside and renamed into place, so a concurrent start never maps half a file.
+    const std::string tempPath = binaryPath + ".tmp";
+    {
+      std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+      file.write(reinterpret_cast<const char*>(binary.data()), std::streamsize(binary.size()));
+    }
+    std::filesystem::rename(tempPath, binaryPath, ec);
+
+    if (ec || !map(binaryPath, sourceSize, sourceTime))
+      std::cout << "Failed to write " << binaryPath << ", Vulkan type lookups are disabled" << std::endl;
+  }
+
+
+  VulkanRegistry::~VulkanRegistry() {
+    unmap();
+  }
+
+
+  VulkanRegistry* VulkanRegistry::instance() {
+    static std::unique_ptr<VulkanRegistry> s_instance =
+      std::make_unique<VulkanRegistry>(g_registryPath);
+
+    return s_instance.get();
+  }
+
+
+  bool VulkanRegistry::map(const std::string& binaryPath, uint64_t sourceSize, int64_t sourceTime) {
+    const int fd = open(binaryPath.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+      close(fd);
+      return false;
+    }
+
+    void* mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+      return false;
+
+    m_mapping     = static_cast<const uint8_t*>(mapping);
+    m_mappingSize = size_t(info.st_size);
+    m_header      = reinterpret_cast<const Header*>(m_mapping);
+
+    const Header& header   = *m_header;
+    const bool    fresh    = sourceSize == 0 || (header.sourceSize == sourceSize && header.sourceTime == sourceTime);
+    const bool    expected = std::memcmp(header.magic, g_binaryMagic, sizeof(g_binaryMagic)) == 0 && header.version == g_binaryVersion;
+
+    const uint64_t bucketBytes  = uint64_t(header.bucketCount)  * sizeof(uint32_t);
+    const uint64_t typeBytes    = uint64_t(header.typeCount)    * sizeof(TypeRecord);
+    const uint64_t memberBytes  = uint64_t(header.memberCount)  * sizeof(MemberRecord);
+    const uint64_t nameBytes    = uint64_t(header.nameCount)    * sizeof(NameRecord);
+    const uint64_t trigramBytes = uint64_t(header.trigramCount) * sizeof(TrigramRecord);
+    const uint64_t postingBytes = uint64_t(header.postingCount) * sizeof(uint32_t);
+    const uint64_t totalBytes   = sizeof(Header) + bucketBytes + typeBytes + memberBytes + nameBytes + trigramBytes + postingBytes + header.stringBytes;
+
+    if (!expected || !fresh || totalBytes != m_mappingSize || header.stringBytes == 0 || !std::has_single_bit(header.bucketCount)) {
+      unmap();
+      return false;
+    }
+
+    const uint8_t* section = m_mapping + sizeof(Header);
+    m_buckets  = reinterpret_cast<const uint32_t*>(section);      section += bucketBytes;
+    m_types    = reinterpret_cast<const TypeRecord*>(section);    section += typeBytes;
+    m_members  = reinterpret_cast<const MemberRecord*>(section);  section += memberBytes;
+    m_names    = reinterpret_cast<const NameRecord*>(section);    section += nameBytes;
+    m_trigrams = reinterpret_cast<const TrigramRecord*>(section); section += trigramBytes;
+    m_postings = reinterpret_cast<const uint32_t*>(section);      section += postingBytes;
+    m_strings  = reinterpret_cast<const char*>(section);
+
+    // Records are read in place, so anything that would point outside the file means it's corrupt.
+    bool valid = m_strings[header.stringBytes - 1] == '\0';
+
+    for (uint32_t i = 0; valid && i < header.bucketCount; i++)
+      valid = m_buckets[i] == g_noType || m_buckets[i] < header.typeCount;
+
+    for (uint32_t i = 0; valid && i < header.typeCount; i++) {
+      const TypeRecord& type = m_types[i];
+      valid = type.name < header.stringBytes && type.structName < header.stringBytes &&
+        uint64_t(type.firstMember) + type.memberCount <= header.memberCount &&
+        (type.nextInBucket == g_noType || type.nextInBucket < header.typeCount);
+    }
+
+    for (uint32_t i = 0; valid && i < header.memberCount; i++) {
+      const MemberRecord& member = m_members[i];
+      valid = member.type < header.stringBytes && member.name < header.stringBytes && member.comment < header.stringBytes &&
+        member.values < header.stringBytes && member.optional < header.stringBytes && member.len < header.stringBytes;
+    }
+
+    for (uint32_t i = 0; valid && i < header.nameCount; i++)
+      valid = m_names[i].name < header.stringBytes;
+
+    for (uint32_t i = 0; valid && i < header.trigramCount; i++)
+      valid = uint64_t(m_trigrams[i].firstPosting) + m_trigrams[i].postingCount <= header.postingCount;
+
+    for (uint32_t i = 0; valid && i < header.postingCount; i++)
+      valid = m_postings[i] < header.nameCount;
+
+    if (!valid) {
+      unmap();
+      return false;
+    }
+
+    return true;
+  }
+
+
+  void VulkanRegistry::unmap() {
+    if (m_mapping != nullptr)
+      munmap(const_cast<uint8_t*>(m_mapping), m_mappingSize);
+
+    m_mapping     = nullptr;
+    m_mappingSize = 0;
+    m_header      = nullptr;
+    m_buckets     = nullptr;
+    m_types       = nullptr;
+    m_members     = nullptr;
+    m_names       = nullptr;
+    m_trigrams    = nullptr;
+    m_postings    = nullptr;
+    m_strings     = nullptr;
+  }
+
+
+  size_t VulkanRegistry::size() const {
+    return m_header != nullptr ? m_header->typeCount : 0;
+  }
+
+
+  std::string_view VulkanRegistry::string(uint32_t offset) const {
+    return m_strings + offset;
+  }
+
+
+  const std::string* VulkanRegistry::find(std::string_view name) {
+    if (m_header == nullptr)
+      return nullptr;
+
+    uint32_t index = m_buckets[hashName(name) & (m_header->bucketCount - 1)];
+    while (index != g_noType && string(m_types[index].name) != name)
+      index = m_types[index].nextInBucket;
+
+    if (index == g_noType)
+      return nullptr;
+
+    std::lock_guard lock(m_formattedMutex);
+
+    // Entries are never changed once added, so handing out pointers is safe.
+    auto [entry, inserted] = m_formatted.try_emplace(index);
+    if (inserted)
+      entry->second = format(m_types[index]);
+
+    return &entry->second;
+  }
+
+
+  std::vector<VulkanRegistry::Match> VulkanRegistry::suggest(std::string_view name, size_t count) const {
+    if (m_header == nullptr || count == 0)
+      return { };
+
+    std::vector<uint32_t> trigrams;
+    collectTrigrams(name, true, trigrams);
+
+    // Counts how many of the query's trigrams each name shares.
+    std::vector<uint16_t> shared(m_header->nameCount);
+    std::vector<uint32_t> candidates;
+    for (uint32_t trigram : trigrams) {
+      // Trigrams like "$vk" are in nearly every name, counting them would only cost time.
+      const TrigramRecord* record = findTrigram(trigram);
+      if (record == nullptr || record->postingCount > m_header->nameCount / 2)
+        continue;
+
+      for (uint32_t i = 0; i < record->postingCount; i++) {
+        const uint32_t nameIndex = m_postings[record->firstPosting + i];
+        if (shared[nameIndex]++ == 0)
+          candidates.push_back(nameIndex);
+      }
+    }
+
+    // Only the names sharing the most trigrams are worth an exact distance.
+    const size_t considered = std::min(candidates.size(), std::max(count * 8, g_minFuzzyCandidates));
+    std::nth_element(candidates.begin(), candidates.begin() + considered, candidates.end(), [&](uint32_t a, uint32_t b) {
+      return shared[a] != shared[b] ? shared[a] > shared[b] : a < b;
+    });
+    candidates.resize(considered);
+
+    struct Ranked {
+      uint32_t distance;
+      uint32_t shared;
+      uint32_t nameIndex;
+    };
+
+    // Anything that needs more than half the name rewritten isn't what they meant.
+    const uint32_t maxDistance = std::max<uint32_t>(2, uint32_t(name.length() / 2));
+
+    std::vector<uint32_t> previous, current;
+    std::vector<Ranked>   ranked;
+    for (uint32_t nameIndex : candidates) {
+      const uint32_t distance = editDistance(name, string(m_names[nameIndex].name), maxDistance, previous, current);
+      if (distance <= maxDistance)
+        ranked.push_back({ distance, shared[nameIndex], nameIndex });
+    }
+
+    std::sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+      if (a.distance != b.distance) return a.distance < b.distance;
+      if (a.shared   != b.shared)   return a.shared   > b.shared;
+      return a.nameIndex < b.nameIndex;
+    });
+
+    std::vector<Match> matches;
+    for (size_t i = 0; i < std::min(count, ranked.size()); i++)
+      matches.push_back(match(ranked[i].nameIndex));
+
+    return matches;
+  }
+
+
+  std::vector<VulkanRegistry::Match> VulkanRegistry::search(std::string_view pattern) const {
+    if (m_header == nullptr)
+      return { };
+
+    const NameRecord* begin = m_names;
+    const NameRecord* end   = m_names + m_header->nameCount;
+
+    std::vector<Match> matches;
+
+    // Names are sorted, so a literal prefix narrows things down to one range.
+    const std::string_view prefix = pattern.substr(0, pattern.find('*'));
+    if (!prefix.empty()) {
+      const NameRecord* first = std::partition_point(begin, end, [&](const NameRecord& record) {
+        const std::string_view name = string(record.name);
+        return lessIgnoringCase(name, prefix) && !startsWithIgnoringCase(name, prefix);
+      });
+
+      for (const NameRecord* record = first; record != end && startsWithIgnoringCase(string(record->name), prefix); record++) {
+        if (globMatch(string(record->name), pattern))
+          matches.push_back(match(uint32_t(record - m_names)));
+      }
+
+      return matches;
+    }
+
+    // Otherwise only names containing every trigram of the longest literal piece can match,
+    // and the rarest of those trigrams gives the fewest names to check.
+    std::string_view longest;
+    for (size_t start = 0; start < pattern.length(); ) {
+      const size_t           star  = std::min(pattern.find('*', start), pattern.length());
+      const std::string_view piece = pattern.substr(start, star - start);
+      if (piece.length() > longest.length())
+        longest = piece;
+      start = star + 1;
+    }
+
+    std::vector<uint32_t> trigrams;
+    collectTrigrams(longest, false, trigrams);
+
+    const TrigramRecord* rarest = nullptr;
+    for (uint32_t trigram : trigrams) {
+      const TrigramRecord* record = findTrigram(trigram);
+      if (record == nullptr)
+        return matches;
+
+      if (rarest == nullptr || record->postingCount < rarest->postingCount)
+        rarest = record;
+    }
+
+    if (rarest == nullptr) {
+      for (const NameRecord* record = begin; record != end; record++) {
+        if (globMatch(string(record->name), pattern))
+          matches.push_back(match(uint32_t(record - m_names)));
+      }
+
+      return matches;
+    }
+
+    for (uint32_t i = 0; i < rarest->postingCount; i++) {
+      const uint32_t nameIndex = m_postings[rarest->firstPosting + i];
+      if (globMatch(string(m_names[nameIndex].name), pattern))
+        matches.push_back(match(nameIndex));
+    }
+
+    return matches;
+  }
+
+
+  const VulkanRegistry::TrigramRecord* VulkanRegistry::findTrigram(uint32_t key) const {
+    const TrigramRecord* begin = m_trigrams;
+    const TrigramRecord* end   = m_trigrams + m_header->trigramCount;
+
+    const TrigramRecord* record = std::lower_bound(begin, end, key, [](const TrigramRecord& record, uint32_t key) { return record.key < key; });
+
+    return record != end && record->key == key
+      ? record
+      : nullptr;
+  }
+
+
+  VulkanRegistry::Match VulkanRegistry::match(uint32_t nameIndex) const {
+    return Match {
+      .name    = string(m_names[nameIndex].name),
+      .command = (m_names[nameIndex].flags & g_nameCommand) != 0,
+    };
+  }
+
+
+  std::string VulkanRegistry::format(const TypeRecord& type) const {
+    std::stringstream stream;
+
+    const MemberRecord* members = m_members + type.firstMember;
+
+    stream << "```cpp\n";
+    stream << "struct " << string(type.structName) << " {" << "\n";
+
+    // Loop through members to find max lengths
+    size_t maxTypeLength = 0;
+    for (uint32_t i = 0; i < type.memberCount; i++) {
+      size_t extraSize = 0;
+      if (members[i].flags & g_memberConst)   extraSize += 6;
+      if (members[i].flags & g_memberPointer) extraSize += 1;
+
+      maxTypeLength = std::max(maxTypeLength, string(members[i].type).length() + extraSize);
+    }
+
+    // Loop through again to output.
+    for (uint32_t i = 0; i < type.memberCount; i++) {
+      const MemberRecord& member = members[i];
+
+      const std::string_view memberType     = string(member.type);
+      const std::string_view memberOptional = string(member.optional);
+      const std::string_view memberLen      = string(member.len);
+
+      if (member.comment)
+        stream << "\t// " << string(member.comment) << "\n";
+
+      {
+        bool lengthBased = false;
+        const char *optionalType = NULL;
+        if (memberOptional == "true")
+          optionalType = "May always be NULL/0.";
+        else if (memberOptional == "true,false" || memberOptional == "true, false")
+          optionalType = "Children must be valid";
+        else if (memberOptional == "false,true" || memberOptional == "false, true")
+          optionalType = "Optional values, pointer required";
+        else if (member.len) {
+          lengthBased = true;
+          optionalType = "May be NULL if ";
+        }
+
+        if (optionalType)
+          stream << "\t// Optional: " << optionalType;
+
+        if (lengthBased)
+          stream << memberLen << " is 0";
+
+        stream << "\n";
+      }
+
+      if (member.len)
+        stream << "\t// Length: " << memberLen << "\n";
+
+      if (member.values)
+        stream << "\t// Values: " << string(member.values) << "\n";
+
+      stream << "\t";
+      if (member.flags & g_memberConst) stream << "const ";
+      stream << memberType;
+      if (member.flags & g_memberPointer) stream << "*";
+      stream << " ";
+
+      size_t extraSize = 0;
+      if (member.flags & g_memberConst)   extraSize += 6;
+      if (member.flags & g_memberPointer) extraSize += 1;
+
+      size_t spaces = maxTypeLength - (memberType.length() + extraSize);
+      for (size_t j = 0; j < spaces; j++)
+        stream << " ";
+
+      stream << "  " << string(member.name) << ";";
+
+      stream << "\n";
+    }
+
+    stream << "};\n";
+    stream << "```";
+    stream << g_manPageUrl << string(type.name) << ".html";
+
+    return stream.str();
+  }
+
+}
\ No newline at end of file
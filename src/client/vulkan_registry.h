@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace shadey {
+
+  // The struct definitions from vk.xml.
+  //
+  // The XML is only parsed when its compact binary form next to it
+  // (vk.xml.bin) is missing or older than it. Otherwise the binary file is
+  // mapped and its records are read in place, so startup is near-instant and
+  // nothing but the pages that lookups touch stays resident.
+  class VulkanRegistry : public NonCopyable {
+  public:
+    VulkanRegistry(const std::string& path);
+
+    ~VulkanRegistry();
+
+    // Loads vk.xml from the working directory on first use.
+    // Call it at startup so no command pays for the load.
+    static VulkanRegistry* instance();
+
+    // The formatted definition with a link to its man page, nullptr if there is no such type.
+    // Aliases show the type they alias. Formatted once per type, then cached.
+    const std::string* find(std::string_view name);
+
+    struct Match {
+      std::string_view name;
+      // Commands are searchable but have no definition to show.
+      bool             command = false;
+    };
+
+    // The closest names to one that wasn't found, best first, by edit distance ignoring case.
+    std::vector<Match> suggest(std::string_view name, size_t count) const;
+
+    // Every name matching a pattern like VkPhysicalDevice*Features, ignoring case.
+    std::vector<Match> search(std::string_view pattern) const;
+
+    size_t size() const;
+
+  private:
+    struct Header;
+    struct TypeRecord;
+    struct MemberRecord;
+    struct NameRecord;
+    struct TrigramRecord;
+
+    // Parses vk.xml into the binary layout, empty if it couldn't be read.
+    static std::vector<uint8_t> build(const std::string& path, uint64_t sourceSize, int64_t sourceTime);
+
+    bool map(const std::string& binaryPath, uint64_t sourceSize, int64_t sourceTime);
+
+    void unmap();
+
+    std::string_view string(uint32_t offset) const;
+
+    std::string format(const TypeRecord& type) const;
+
+    const TrigramRecord* findTrigram(uint32_t key) const;
+
+    Match match(uint32_t nameIndex) const;
+
+    const uint8_t*       m_mapping     = nullptr;
+    size_t               m_mappingSize = 0;
+    const Header*        m_header      = nullptr;
+    const uint32_t*      m_buckets     = nullptr;
+    const TypeRecord*    m_types       = nullptr;
+    const MemberRecord*  m_members     = nullptr;
+    const NameRecord*    m_names       = nullptr;
+    const TrigramRecord* m_trigrams    = nullptr;
+    const uint32_t*      m_postings    = nullptr;
+    const char*          m_strings     = nullptr;
+
+    std::mutex                                m_formattedMutex;
+    std::unordered_map<uint32_t, std::string> m_formatted;
+  };
+
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "golden.h"
+#include "png_encoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "stb_image.h"
+
+namespace shadey {
+
+  namespace {
+    struct DecodedImage {
+      int width  = 0;
+      int height = 0;
+      std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels = { nullptr, &stbi_image_free };
+    };
+
+    static bool decodePng(const std::vector<uint8_t>& png, DecodedImage& image) {
+      int channels = 0;
+      image.pixels.reset(stbi_load_from_memory(png.data(), int(png.size()), &image.width, &image.height, &channels, 4));
+      return image.pixels != nullptr;
+    }
+  }
+
+  GoldenResult compareWithGolden(const std::vector<uint8_t>& renderedPng, const std::filesystem::path& goldenPath, const GoldenOptions& options) {
+    GoldenResult result;
+
+    std::ifstream file(goldenPath, std::ios::binary);
+    if (!file) {
+      result.status = GoldenStatus::Missing;
+      result.error  = "No golden image at " + goldenPath.string();
+      return result;
+    }
+
+    const std::vector<uint8_t> goldenPng{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    DecodedImage rendered;
+    DecodedImage golden;
+    result.status = GoldenStatus::Mismatch;
+
+    if (!decodePng(renderedPng, rendered)) {
+      result.error = std::string("Failed to decode the rendered image: ") + stbi_failure_reason();
+      return result;
+    }
+
+    if (!decodePng(goldenPng, golden)) {
+      result.error = std::string("Failed to decode the golden image: ") + stbi_failure_reason();
+      return result;
+    }
+
+    if (rendered.width != golden.width || rendered.height != golden.height) {
+      result.error = "Rendered " + std::to_string(rendered.width) + "x" + std::to_string(rendered.height) +
+        " but the golden image is " + std::to_string(golden.width) + "x" + std::to_string(golden.height);
+      return result;
+    }
+
+    const size_t pixelCount = size_t(golden.width) * size_t(golden.height);
+    const stbi_uc* a = rendered.pixels.get();
+    const stbi_uc* b = golden.pixels.get();
+
+    std::vector<uint8_t> diff(pixelCount * 4);
+
+    for (size_t i = 0; i < pixelCount; i++) {
+      uint32_t pixelDifference = 0;
+      for (size_t c = 0; c < 4; c++)
+        pixelDifference = std::max<uint32_t>(pixelDifference, uint32_t(std::abs(int(a[i * 4 + c]) - int(b[i * 4 + c]))));
+
+      result.maxDifference = std::max(result.maxDifference, pixelDifference);
+
+      uint8_t* out = &diff[i * 4];
+      if (pixelDifference > options.tolerance) {
+        result.badPixels++;
+        out[0] = 255;
+        out[1] = 0;
+        out[2] = 0;
+      }
+      else {
+        out[0] = uint8_t(b[i * 4 + 0] / 4);
+        out[1] = uint8_t(b[i * 4 + 1] / 4);
+        out[2] = uint8_t(b[i * 4 + 2] / 4);
+      }
+      out[3] = 255;
+    }
+
+    if (result.badPixels <= options.maxBadPixels) {
+      result.status = GoldenStatus::Match;
+      return result;
+    }
+
+    result.diffPng = encodePng(diff.data(), uint32_t(golden.width), uint32_t(golden.height), uint32_t(golden.width) * 4, PngCompression::Fast);
+    return result;
+  }
+
+
+  const char* goldenStatusName(GoldenStatus status) {
+    switch (status) {
+      case GoldenStatus::Match:    return "match";
+      case GoldenStatus::Mismatch: return "mismatch";
+      default:
+      case GoldenStatus::Missing:  return "missing";
+    }
+  }
+
+}
\ No newline at end of file
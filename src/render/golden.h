@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace shadey {
+
+  enum class GoldenStatus {
+    Match,
+    Mismatch,
+    Missing,
+  };
+
+  struct GoldenOptions {
+    // Largest per-channel difference that still counts as the same pixel.
+    // Software and hardware rasterizers round differently, so exact matches are too strict.
+    uint32_t tolerance    = 2;
+    // How many pixels may exceed the tolerance before the case fails.
+    uint64_t maxBadPixels = 0;
+  };
+
+  struct GoldenResult {
+    GoldenStatus status        = GoldenStatus::Missing;
+    std::string  error;
+    uint32_t     maxDifference = 0;
+    uint64_t     badPixels     = 0;
+    // Bad pixels in red over a faded copy of the golden image, empty unless it mismatched.
+    std::vector<uint8_t> diffPng;
+  };
+
+  // Decodes both PNGs and compares them pixel by pixel.
+  GoldenResult compareWithGolden(const std::vector<uint8_t>& renderedPng, const std::filesystem::path& goldenPath, const GoldenOptions& options);
+
+  const char* goldenStatusName(GoldenStatus status);
+
+}
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "command_parser.h"
+#include "device_scheduler.h"
+#include "executor.h"
+#include "golden.h"
+#include "json_helpers.h"
+#include "renderer.h"
+#include "render_context.h"
+#include "shader_cache.h"
+#include "task.h"
+
+// Offline renderer for headless boxes.
+//
+// Renders every .glsl and .hlsl file under a directory through the same
+// compiler, directive parser and renderer as the bot, and prints per-file,
+// per-stage timings and overall throughput as JSON on stdout. .md files are
+// read like a Discord message, so they can carry several stages.
+//
+// With --golden it doubles as a regression suite: each render is compared
+// against <golden dir>/<name>.png and the run fails on any mismatch.
+// Regenerate the golden images with --out <golden dir>. Run it on lavapipe or
+// SwiftShader (--device llvmpipe / --device SwiftShader, or point
+// VK_ICD_FILENAMES at the software driver) so results don't depend on the GPU.
+// Without --device files are spread over every device, each noting which one it got.
+
+namespace shadey {
+
+  namespace {
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::string_view g_usage =
+      "Usage: shadey-render <shader dir> [--out <dir>] [--jobs <n>] [--no-disk-cache] [--device <name>]\n"
+      "                     [--golden <dir>] [--tolerance <n>] [--max-bad-pixels <n>]\n";
+
+    struct RenderCliOptions {
+      std::filesystem::path input;
+      std::filesystem::path output;
+      std::filesystem::path golden;
+      std::string           device;
+      GoldenOptions         goldenOptions;
+      uint32_t              jobs      = std::max(std::thread::hardware_concurrency(), 1u);
+      bool                  diskCache = true;
+    };
+
+    struct FileResult {
+      std::filesystem::path path;
+      std::string           device;
+      bool                  ok      = false;
+      std::string           error;
+      uint32_t              width   = 0;
+      uint32_t              height  = 0;
+      size_t                bytes   = 0;
+      double                readMs  = 0.0;
+      double                writeMs = 0.0;
+      double                totalMs = 0.0;
+      RendererTimings       timings = { };
+      bool                  compared = false;
+      GoldenResult          golden;
+    };
+
+    struct RenderCliState {
+      const RenderCliOptions& options;
+      std::vector<FileResult> results;
+      std::atomic<size_t>     next = 0;
+      std::latch              done;
+    };
+
+    static double elapsedMs(Clock::time_point start) {
+      return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    template <typename T>
+    static bool parseNumber(std::string_view str, T& value) {
+      auto [end, error] = std::from_chars(str.data(), str.data() + str.length(), value);
+      return error == std::errc() && end == str.data() + str.length();
+    }
+
+    static bool parseArgs(int argc, char** argv, RenderCliOptions& options) {
+      for (int i = 1; i < argc; i++) {
+        const std::string_view arg  = argv[i];
+        const bool             more = i + 1 < argc;
+
+        if ((arg == "--out" || arg == "-o") && more) {
+          options.output = argv[++i];
+        }
+        else if ((arg == "--jobs" || arg == "-j") && more) {
+          if (!parseNumber(argv[++i], options.jobs) || options.jobs == 0)
+            return false;
+        }
+        else if (arg == "--device" && more) {
+          options.device = argv[++i];
+        }
+        else if (arg == "--golden" && more) {
+          options.golden = argv[++i];
+        }
+        else if (arg == "--tolerance" && more) {
+          if (!parseNumber(argv[++i], options.goldenOptions.tolerance))
+            return false;
+        }
+        else if (arg == "--max-bad-pixels" && more) {
+          if (!parseNumber(argv[++i], options.goldenOptions.maxBadPixels))
+            return false;
+        }
+        else if (arg == "--no-disk-cache") {
+          options.diskCache = false;
+        }
+        else if (options.input.empty() && !arg.starts_with("-")) {
+          options.input = arg;
+        }
+        else {
+          return false;
+        }
+      }
+
+      return !options.input.empty();
+    }
+
+    static std::vector<std::filesystem::path> findShaders(const std::filesystem::path& directory) {
+      std::vector<std::filesystem::path> paths;
+      for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".glsl" || extension == ".hlsl" || extension == ".md"))
+          paths.push_back(entry.path());
+      }
+
+      std::sort(paths.begin(), paths.end());
+      return paths;
+    }
+
+    static std::string readFile(const std::filesystem::path& path) {
+      std::ifstream file(path, std::ios::binary);
+      if (!file)
+        throw std::runtime_error("Failed to open " + path.string());
+
+      std::stringstream stream;
+      stream << file.rdbuf();
+      return stream.str();
+    }
+
+    static void writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+      std::filesystem::create_directories(path.parent_path());
+
+      std::ofstream file(path, std::ios::binary);
+      if (!file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size())))
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    static Task<> renderFile(const RenderCliOptions& options, FileResult& result) {
+      const auto start = Clock::now();
+
+      RenderContext& context = DeviceScheduler::get().pick();
+      result.device = context.deviceName();
+
+      Renderer renderer(context);
+      try {
+        auto stage = Clock::now();
+        std::string code = readFile(result.path);
+        result.readMs = elapsedMs(stage);
+
+        ShaderProgram program;
+        if (result.path.extension() == ".md") {
+          if (!extractShaderProgram(code, program))
+            throw std::runtime_error("No ```glsl or ```hlsl block in " + result.path.string());
+        }
+        else {
+          program.hlsl     = result.path.extension() == ".hlsl";
+          program.fragment = std::move(code);
+        }
+
+        auto png = co_await renderer.render(std::move(program));
+        result.bytes = png.size();
+
+        const auto name = std::filesystem::relative(result.path, options.input).replace_extension(".png");
+
+        if (!options.output.empty()) {
+          stage = Clock::now();
+          writeFile(options.output / name, png);
+          result.writeMs = elapsedMs(stage);
+        }
+
+        if (!options.golden.empty()) {
+          result.golden   = compareWithGolden(png, options.golden / name, options.goldenOptions);
+          result.compared = true;
+
+          if (!result.golden.diffPng.empty() && !options.output.empty())
+            writeFile(options.output / std::filesystem::path(name).replace_extension(".diff.png"), result.golden.diffPng);
+        }
+
+        result.ok = true;
+      }
+      catch (const std::exception& e) {
+        result.error = e.what();
+      }
+
+      // Partial timings are still useful when a later stage failed.
+      result.timings = renderer.timings();
+      result.width   = renderer.options().resolution[0];
+      result.height  = renderer.options().resolution[1];
+      result.totalMs = elapsedMs(start);
+    }
+
+    // Each worker keeps one file in flight until there are none left.
+    static Task<> renderWorker(RenderCliState& state) {
+      co_await Executor::instance()->schedule();
+
+      for (size_t i = state.next++; i < state.results.size(); i = state.next++)
+        co_await renderFile(state.options, state.results[i]);
+
+      state.done.count_down();
+    }
+
+    static void writeTimings(std::ostream& stream, const RendererTimings& timings, double readMs, double writeMs) {
+      stream << "{ \"read\": "     << readMs
+             << ", \"parse\": "    << timings.parseMs
+             << ", \"compile\": "  << timings.compileMs
+             << ", \"pipeline\": " << timings.pipelineMs
+             << ", \"record\": "   << timings.recordMs
+             << ", \"gpu\": "      << timings.gpuMs
+             << ", \"encode\": "   << timings.encodeMs
+             << ", \"write\": "    << writeMs << " }";
+    }
+
+    static void writeReport(std::ostream& stream, const RenderCliState& state, double wallMs) {
+      RendererTimings stageTotals = { };
+      double          readTotal   = 0.0;
+      double          writeTotal  = 0.0;
+      size_t          failed      = 0;
+      double          pixels      = 0.0;
+      size_t          bytes       = 0;
+      size_t          goldenFails = 0;
+
+      stream << std::fixed << std::setprecision(3);
+      stream << "{\n";
+      stream << "  \"device\": " << jsonString(DeviceScheduler::get().primary().deviceName()) << ",\n";
+      stream << "  \"jobs\": " << state.options.jobs << ",\n";
+      stream << "  \"files\": [\n";
+
+      for (size_t i = 0; i < state.results.size(); i++) {
+        const FileResult& result = state.results[i];
+
+        stream << "    { \"file\": " << jsonString(std::filesystem::relative(result.path, state.options.input).generic_string())
+               << ", \"device\": " << jsonString(result.device)
+               << ", \"ok\": " << (result.ok ? "true" : "false");
+
+        if (result.ok) {
+          stream << ", \"width\": " << result.width
+                 << ", \"height\": " << result.height
+                 << ", \"bytes\": " << result.bytes;
+        }
+        else {
+          stream << ", \"error\": " << jsonString(result.error);
+        }
+
+        if (result.compared) {
+          stream << ", \"golden\": { \"status\": " << jsonString(goldenStatusName(result.golden.status))
+                 << ", \"max_difference\": " << result.golden.maxDifference
+                 << ", \"bad_pixels\": " << result.golden.badPixels;
+
+          if (!result.golden.error.empty())
+            stream << ", \"error\": " << jsonString(result.golden.error);
+
+          stream << " }";
+        }
+
+        stream << ", \"total_ms\": " << result.totalMs << ", \"stages_ms\": ";
+        writeTimings(stream, result.timings, result.readMs, result.writeMs);
+        stream << " }" << (i + 1 < state.results.size() ? "," : "") << "\n";
+
+        if (result.compared && result.golden.status != GoldenStatus::Match)
+          goldenFails++;
+
+        if (!result.ok) {
+          failed++;
+          continue;
+        }
+
+        stageTotals.parseMs    += result.timings.parseMs;
+        stageTotals.compileMs  += result.timings.compileMs;
+        stageTotals.pipelineMs += result.timings.pipelineMs;
+        stageTotals.recordMs   += result.timings.recordMs;
+        stageTotals.gpuMs      += result.timings.gpuMs;
+        stageTotals.encodeMs   += result.timings.encodeMs;
+        readTotal              += result.readMs;
+        writeTotal             += result.writeMs;
+        pixels                 += double(result.width) * double(result.height);
+        bytes                  += result.bytes;
+      }
+
+      const double seconds   = wallMs / 1000.0;
+      const size_t succeeded = state.results.size() - failed;
+
+      stream << "  ],\n";
+      stream << "  \"summary\": {\n";
+      stream << "    \"rendered\": " << succeeded << ",\n";
+      stream << "    \"failed\": " << failed << ",\n";
+      if (!state.options.golden.empty())
+        stream << "    \"golden_failures\": " << goldenFails << ",\n";
+      stream << "    \"wall_ms\": " << wallMs << ",\n";
+      stream << "    \"files_per_second\": " << (seconds > 0.0 ? double(succeeded) / seconds : 0.0) << ",\n";
+      stream << "    \"megapixels_per_second\": " << (seconds > 0.0 ? pixels / 1'000'000.0 / seconds : 0.0) << ",\n";
+      stream << "    \"encoded_bytes\": " << bytes << ",\n";
+      stream << "    \"stage_totals_ms\": ";
+      writeTimings(stream, stageTotals, readTotal, writeTotal);
+      stream << "\n";
+      stream << "  }\n";
+      stream << "}\n";
+    }
+  }
+
+  static int runRenderCli(int argc, char** argv) {
+    RenderCliOptions options;
+    if (!parseArgs(argc, argv, options)) {
+      std::cerr << g_usage;
+      return 2;
+    }
+
+    std::vector<std::filesystem::path> paths;
+    try {
+      paths = findShaders(options.input);
+
+      // Otherwise a warm cache from a previous run hides compile times.
+      if (!options.diskCache)
+        ShaderCache::instance()->setDiskDirectory("");
+
+      DeviceScheduler::create(options.device);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "shadey-render: " << e.what() << "\n";
+      return 1;
+    }
+
+    const uint32_t workers = uint32_t(std::min<size_t>(options.jobs, std::max<size_t>(paths.size(), 1)));
+
+    RenderCliState state = {
+      .options = options,
+      .results = std::vector<FileResult>(paths.size()),
+      .done    = std::latch(workers),
+    };
+
+    for (size_t i = 0; i < paths.size(); i++)
+      state.results[i].path = paths[i];
+
+    const auto start = Clock::now();
+    for (uint32_t i = 0; i < workers; i++)
+      spawn(renderWorker(state));
+    state.done.wait();
+
+    writeReport(std::cout, state, elapsedMs(start));
+
+    for (auto& device : DeviceScheduler::get().devices())
+      device->savePipelineCache();
+
+    const bool passed = std::all_of(state.results.begin(), state.results.end(), [&](const FileResult& result) {
+      return result.ok && (!result.compared || result.golden.status == GoldenStatus::Match);
+    });
+
+    return passed ? 0 : 1;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  return shadey::runRenderCli(argc, argv);
+}
\ No newline at end of file
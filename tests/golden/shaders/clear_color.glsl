@@ -0,0 +1,11 @@
+#version 450
+
+// SHADEY: resolution = 40 30
+// SHADEY: clearColor = 0.8 0.2 0.4 1.0
+
+layout(location = 0) out vec4 fragColor;
+
+// Nothing gets drawn, only the clear colour is left.
+void main() {
+  discard;
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 450
+
+// SHADEY: type = compute
+// SHADEY: resolution = 36 40
+
+// Not the 8x8 default, and 40 doesn't divide by 16, so the edge groups run past the image.
+layout(local_size_x = 4, local_size_y = 16) in;
+
+layout(push_constant) uniform Shadey { float time; uint frame; vec2 resolution; } shadey;
+
+layout(binding = 0, rgba8) uniform writeonly image2D shadeyOutput;
+
+void main() {
+  vec2 coord = vec2(gl_GlobalInvocationID.xy) + 0.5;
+  imageStore(shadeyOutput, ivec2(gl_GlobalInvocationID.xy), vec4(coord / shadey.resolution, 0.25, 1.0));
+}
\ No newline at end of file
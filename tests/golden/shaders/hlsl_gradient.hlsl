@@ -0,0 +1,7 @@
+// SHADEY: resolution = 33 17
+
+[[vk::push_constant]] struct { float time; uint frame; float2 resolution; } shadey;
+
+float4 main(float4 position : SV_Position) : SV_Target {
+  return float4(0.75, position.xy / shadey.resolution, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 450
+
+// SHADEY: resolution = 37 23
+
+layout(push_constant) uniform Shadey { float time; uint frame; vec2 resolution; } shadey;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  fragColor = vec4(fract(gl_FragCoord.x / 8.0), gl_FragCoord.y / shadey.resolution.y, 0.75, 1.0);
+}
\ No newline at end of file
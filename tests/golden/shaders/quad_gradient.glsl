@@ -0,0 +1,11 @@
+#version 450
+
+// SHADEY: resolution = 64 64
+
+layout(push_constant) uniform Shadey { float time; uint frame; vec2 resolution; } shadey;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  fragColor = vec4(gl_FragCoord.xy / shadey.resolution, 0.25, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 450
+
+// SHADEY: type = triangle
+// SHADEY: resolution = 64 64
+// SHADEY: clearColor = 0.2 0.4 0.6 1.0
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  fragColor = vec4(1.0, 0.25, 0.0, 1.0);
+}
\ No newline at end of file